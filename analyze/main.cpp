@@ -0,0 +1,551 @@
+//
+//  main.cpp
+//  analyze
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/BinaryFormat.hpp"
+
+// How a trial ended, as the exports record it.
+enum Outcome {
+    Response,
+    Timeout,
+    FalseStart
+};
+
+// Reaction times of one milestone or position, and the trials that weren't a response.
+struct Group {
+    std::vector<int64_t> reactionTimes;     // microseconds
+    uint64_t timeouts = 0;
+    uint64_t falseStarts = 0;
+    uint64_t events = 0;
+
+    void add(int64_t reactionTime, uint32_t outcome) {
+        if (outcome == Timeout) {
+            timeouts++;
+        } else if (outcome == FalseStart) {
+            falseStarts++;
+        } else {
+            reactionTimes.push_back(reactionTime);
+        }
+    }
+
+    void merge(Group& other) {
+        reactionTimes.insert(reactionTimes.end(), other.reactionTimes.begin(), other.reactionTimes.end());
+        std::vector<int64_t>().swap(other.reactionTimes);
+        timeouts += other.timeouts;
+        falseStarts += other.falseStarts;
+        events += other.events;
+    }
+};
+
+// What one worker gathered from the files it parsed.
+struct Partial {
+    std::vector<Group> milestones;                      // by milestone index
+    std::unordered_map<std::string, Group> positions;   // by position, "" never appears
+    std::unordered_map<std::string, uint64_t> events;   // by event name
+    uint64_t files = 0;
+    uint64_t reactions = 0;
+    uint64_t eventRecords = 0;
+    uint64_t bytes = 0;
+    std::vector<std::string> failed;
+
+    Group& milestone(uint32_t index) {
+        if (milestones.size() <= index) {
+            milestones.resize(index + 1);
+        }
+        return milestones[index];
+    }
+
+    // Timeouts leave the position empty, so only answered trials count towards a position.
+    void addReaction(uint32_t milestoneIndex, int64_t reactionTime, const char* position, size_t positionLength, uint32_t outcome) {
+        milestone(milestoneIndex).add(reactionTime, outcome);
+        if (positionLength > 0) {
+            positions[std::string(position, positionLength)].add(reactionTime, outcome);
+        }
+        reactions++;
+    }
+
+    void addEvent(uint32_t milestoneIndex, const std::string& name) {
+        milestone(milestoneIndex).events++;
+        events[name]++;
+        eventRecords++;
+    }
+};
+
+// One value of an exported record.
+struct Value {
+    bool isString = false;
+    int64_t integer = 0;
+    std::string text;
+};
+
+// Cursor over the text of one JSON export. The exports are machine written, so only their
+// layout is accepted: arrays of integers and strings, nothing else.
+class Scanner {
+public:
+    Scanner(const char* begin, const char* end) : _p(begin), _end(end) {}
+
+    bool consume(char c) {
+        skipSpace();
+        if (_p < _end && *_p == c) {
+            _p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return _p == _end;
+    }
+
+    bool value(Value& value) {
+        skipSpace();
+        if (_p < _end && *_p == '"') {
+            value.isString = true;
+            return string(value.text);
+        }
+        value.isString = false;
+        return integer(value.integer);
+    }
+
+    bool integer(int64_t& value) {
+        skipSpace();
+        bool negative = _p < _end && *_p == '-';
+        if (negative) {
+            _p++;
+        }
+        const char* digits = _p;
+        uint64_t magnitude = 0;
+        while (_p < _end && static_cast<unsigned>(*_p - '0') < 10) {
+            magnitude = magnitude * 10 + static_cast<unsigned>(*_p - '0');
+            _p++;
+        }
+        value = negative ? -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude);
+        return _p != digits;
+    }
+
+private:
+    void skipSpace() {
+        while (_p < _end && (*_p == ' ' || *_p == '\n' || *_p == '\r' || *_p == '\t')) {
+            _p++;
+        }
+    }
+
+    // memchr finds the closing quote a vector at a time; escapes are rare in positions and names.
+    bool string(std::string& text) {
+        text.clear();
+        _p++;
+        for (;;) {
+            const char* quote = static_cast<const char*>(memchr(_p, '"', _end - _p));
+            if (quote == nullptr) {
+                return false;
+            }
+            const char* backslash = static_cast<const char*>(memchr(_p, '\\', quote - _p));
+            if (backslash == nullptr) {
+                text.append(_p, quote);
+                _p = quote + 1;
+                return true;
+            }
+            text.append(_p, backslash);
+            _p = backslash + 1;
+            if (_p >= _end || !unescape(text)) {
+                return false;
+            }
+        }
+    }
+
+    // The escapes JsonWriter::string writes, plus the rest of JSON's.
+    bool unescape(std::string& text) {
+        char c = *_p++;
+        switch (c) {
+            case '"': case '\\': case '/': text.push_back(c); return true;
+            case 'b': text.push_back('\b'); return true;
+            case 'f': text.push_back('\f'); return true;
+            case 'n': text.push_back('\n'); return true;
+            case 'r': text.push_back('\r'); return true;
+            case 't': text.push_back('\t'); return true;
+            case 'u': break;
+            default: return false;
+        }
+        if (_end - _p < 4) {
+            return false;
+        }
+        unsigned code = 0;
+        for (int i = 0; i < 4; i++, _p++) {
+            char digit = *_p;
+            unsigned nibble = digit >= '0' && digit <= '9' ? digit - '0' : digit >= 'a' && digit <= 'f' ? digit - 'a' + 10 :
+                              digit >= 'A' && digit <= 'F' ? digit - 'A' + 10 : 16;
+            if (nibble > 15) {
+                return false;
+            }
+            code = code << 4 | nibble;
+        }
+        if (code < 0x80) {
+            text.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            text.push_back(static_cast<char>(0xc0 | code >> 6));
+            text.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        } else {
+            text.push_back(static_cast<char>(0xe0 | code >> 12));
+            text.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3f)));
+            text.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+        return true;
+    }
+
+    const char* _p;
+    const char* _end;
+};
+
+// A reactions or events export, told apart per record:
+//   [time,"name"]                                  event
+//   [time,reaction,"position"(,channel),outcome]   reaction in milliseconds
+//   [time,reaction,callback,"position"...]         reaction in microseconds (high resolution)
+//   [time,reaction,position id...]                 reaction exported with position ids, in
+//                                                  microseconds with a callback column if microsecondIds
+// Every reaction ends with its outcome.
+static bool parseJson(const char* text, size_t size, bool microsecondIds, Partial& partial) {
+    Scanner scanner(text, text + size);
+    Value values[6];
+    if (!scanner.consume('[')) {
+        return false;
+    }
+    bool firstGroup = true;
+    while (!scanner.consume(']')) {
+        int64_t milestone;
+        if ((!firstGroup && !scanner.consume(',')) || !scanner.consume('[') || !scanner.integer(milestone) || milestone < 0) {
+            return false;
+        }
+        firstGroup = false;
+        while (scanner.consume(',')) {
+            if (!scanner.consume('[')) {
+                return false;
+            }
+            size_t count = 0;
+            Value last;
+            do {
+                if (!scanner.value(count < 6 ? values[count] : last)) {
+                    return false;
+                }
+                count++;
+            } while (scanner.consume(','));
+            const Value& outcome = count <= 6 ? values[count - 1] : last;
+            if (!scanner.consume(']') || count < 2) {
+                return false;
+            }
+            uint32_t index = static_cast<uint32_t>(milestone);
+            if (values[1].isString) {
+                partial.addEvent(index, values[1].text);
+                continue;
+            }
+            if (count < 4 || outcome.isString) {
+                return false;
+            }
+            uint32_t trialOutcome = static_cast<uint32_t>(outcome.integer);
+            if (values[2].isString) {
+                partial.addReaction(index, values[1].integer * 1000, values[2].text.data(), values[2].text.size(), trialOutcome);
+            } else if (values[3].isString) {
+                partial.addReaction(index, values[1].integer, values[3].text.data(), values[3].text.size(), trialOutcome);
+            } else {
+                const Value& id = values[microsecondIds && count >= 5 ? 3 : 2];
+                std::string position = id.integer != 0 ? "#" + std::to_string(id.integer) : std::string();
+                partial.addReaction(index, microsecondIds ? values[1].integer : values[1].integer * 1000, position.data(), position.size(), trialOutcome);
+            }
+        }
+        if (!scanner.consume(']')) {
+            return false;
+        }
+    }
+    return scanner.atEnd();
+}
+
+// Column at a time, as the format is laid out for.
+static void readBinary(const BinaryFormat::Reader& reader, Partial& partial) {
+    for (uint64_t i = 0; i < reader.reactionCount(); i++) {
+        const char* position = reader.reactionPositionName(i);
+        partial.addReaction(reader.reactionMilestone(i), reader.reactionTime(i), position, strlen(position), reader.reactionOutcome(i));
+    }
+    for (uint64_t i = 0; i < reader.eventCount(); i++) {
+        partial.addEvent(reader.eventMilestone(i), reader.eventName(i));
+    }
+}
+
+static bool analyzeFile(const char* path, bool microsecondIds, Partial& partial) {
+    BinaryFormat::MappedFile file(path);
+    if (file.data() == nullptr) {
+        return false;
+    }
+    const char* text = static_cast<const char*>(file.data());
+    partial.bytes += file.size();
+    if (file.size() >= 4 && memcmp(text, BinaryFormat::k_magic, 4) == 0) {
+        BinaryFormat::Reader reader = file.reader();
+        if (!reader.valid()) {
+            return false;
+        }
+        readBinary(reader, partial);
+        return true;
+    }
+    // a failed file may have added records before the error, so parse into a scratch partial first
+    Partial scratch;
+    if (!parseJson(text, file.size(), microsecondIds, scratch)) {
+        return false;
+    }
+    for (size_t i = 0; i < scratch.milestones.size(); i++) {
+        partial.milestone(static_cast<uint32_t>(i)).merge(scratch.milestones[i]);
+    }
+    for (auto& position : scratch.positions) {
+        partial.positions[position.first].merge(position.second);
+    }
+    for (const auto& event : scratch.events) {
+        partial.events[event.first] += event.second;
+    }
+    partial.reactions += scratch.reactions;
+    partial.eventRecords += scratch.eventRecords;
+    return true;
+}
+
+// Figures of one group; times in milliseconds like MilestoneStats.
+struct Summary {
+    uint64_t trials = 0;
+    uint64_t responses = 0;
+    uint64_t timeouts = 0;
+    uint64_t falseStarts = 0;
+    double timeoutRate = 0;     // timeouts and false starts over trials, as the exports count both as missed
+    double mean = 0;
+    double median = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double min = 0;
+    double max = 0;
+};
+
+// Sorts the reaction times in place. The sum runs over a plain array so the compiler vectorises it.
+static Summary summarize(Group& group) {
+    Summary summary;
+    std::vector<int64_t>& times = group.reactionTimes;
+    summary.responses = times.size();
+    summary.timeouts = group.timeouts;
+    summary.falseStarts = group.falseStarts;
+    summary.trials = times.size() + group.timeouts + group.falseStarts;
+    if (summary.trials > 0) {
+        summary.timeoutRate = static_cast<double>(group.timeouts + group.falseStarts) / summary.trials;
+    }
+    if (times.empty()) {
+        return summary;
+    }
+    const int64_t* data = times.data();
+    size_t count = times.size();
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += data[i];
+    }
+    std::sort(times.begin(), times.end());
+    const double usPerMs = 1000.0;
+    auto quantile = [&](double q) { return times[static_cast<size_t>(q * (count - 1))] / usPerMs; };
+    summary.mean = static_cast<double>(sum) / count / usPerMs;
+    summary.median = quantile(0.5);
+    summary.p90 = quantile(0.9);
+    summary.p99 = quantile(0.99);
+    summary.min = times.front() / usPerMs;
+    summary.max = times.back() / usPerMs;
+    return summary;
+}
+
+static void writeString(FILE* out, const std::string& text) {
+    fputc('"', out);
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+template <typename Field>
+static void writeColumn(FILE* out, const char* name, const std::vector<Summary>& summaries, Field field) {
+    fprintf(out, ",\"%s\":[", name);
+    for (size_t i = 0; i < summaries.size(); i++) {
+        fprintf(out, i == 0 ? "%.10g" : ",%.10g", static_cast<double>(field(summaries[i])));
+    }
+    fputc(']', out);
+}
+
+// Every table is an object of equally long columns, the key column first.
+static void writeSummaryColumns(FILE* out, const std::vector<Summary>& summaries) {
+    writeColumn(out, "trials", summaries, [](const Summary& s) { return s.trials; });
+    writeColumn(out, "responses", summaries, [](const Summary& s) { return s.responses; });
+    writeColumn(out, "timeouts", summaries, [](const Summary& s) { return s.timeouts; });
+    writeColumn(out, "falseStarts", summaries, [](const Summary& s) { return s.falseStarts; });
+    writeColumn(out, "timeoutRate", summaries, [](const Summary& s) { return s.timeoutRate; });
+    writeColumn(out, "mean", summaries, [](const Summary& s) { return s.mean; });
+    writeColumn(out, "median", summaries, [](const Summary& s) { return s.median; });
+    writeColumn(out, "p90", summaries, [](const Summary& s) { return s.p90; });
+    writeColumn(out, "p99", summaries, [](const Summary& s) { return s.p99; });
+    writeColumn(out, "min", summaries, [](const Summary& s) { return s.min; });
+    writeColumn(out, "max", summaries, [](const Summary& s) { return s.max; });
+}
+
+static bool writeResult(const char* path, std::vector<Group>& milestones, std::map<std::string, Group>& positions,
+                        const std::map<std::string, uint64_t>& events) {
+    FILE* out = fopen(path, "wb");
+    if (out == nullptr) {
+        return false;
+    }
+    std::vector<Summary> summaries;
+    fputs("{\"milestones\":{\"milestone\":[", out);
+    for (size_t i = 0; i < milestones.size(); i++) {
+        fprintf(out, i == 0 ? "%zu" : ",%zu", i);
+        summaries.push_back(summarize(milestones[i]));
+    }
+    fputc(']', out);
+    writeSummaryColumns(out, summaries);
+    fputs(",\"events\":[", out);
+    for (size_t i = 0; i < milestones.size(); i++) {
+        fprintf(out, i == 0 ? "%llu" : ",%llu", static_cast<unsigned long long>(milestones[i].events));
+    }
+    fputs("]},\"positions\":{\"position\":[", out);
+    summaries.clear();
+    for (auto& position : positions) {
+        if (!summaries.empty()) {
+            fputc(',', out);
+        }
+        writeString(out, position.first);
+        summaries.push_back(summarize(position.second));
+    }
+    fputc(']', out);
+    writeSummaryColumns(out, summaries);
+    fputs("},\"events\":{\"name\":[", out);
+    bool first = true;
+    for (const auto& event : events) {
+        if (!first) {
+            fputc(',', out);
+        }
+        writeString(out, event.first);
+        first = false;
+    }
+    fputs("],\"count\":[", out);
+    first = true;
+    for (const auto& event : events) {
+        fprintf(out, first ? "%llu" : ",%llu", static_cast<unsigned long long>(event.second));
+        first = false;
+    }
+    fputs("]}}\n", out);
+    return fclose(out) == 0;
+}
+
+// Aggregates many reactions/events exports, JSON or binary: analyze [--jobs n] [--list file]
+// [--microsecond-ids] [--out file] export... Files are parsed in parallel, one worker per core by
+// default, and merged into one result of columns per milestone, per position and per event name.
+// Prints one JSON object with the throughput; exits with 1 if any file couldn't be read.
+int main(int argc, const char * argv[]) {
+    std::vector<std::string> paths;
+    const char* outPath = "analysis.json";
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool microsecondIds = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc) {
+            std::ifstream list(argv[++i]);
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty()) {
+                    paths.push_back(line);
+                }
+            }
+        } else if (strcmp(argv[i], "--microsecond-ids") == 0) {
+            microsecondIds = true;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        fprintf(stderr, "usage: analyze [--jobs n] [--list file] [--microsecond-ids] [--out file] export...\n");
+        return 2;
+    }
+    jobs = std::min(jobs, static_cast<unsigned>(paths.size()));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Partial> partials(jobs);
+    std::atomic<size_t> nextFile(0);
+    std::vector<std::thread> workers;
+    for (unsigned job = 0; job < jobs; job++) {
+        workers.emplace_back([&, job] {
+            Partial& partial = partials[job];
+            for (size_t i = nextFile++; i < paths.size(); i = nextFile++) {
+                if (analyzeFile(paths[i].c_str(), microsecondIds, partial)) {
+                    partial.files++;
+                } else {
+                    partial.failed.push_back(paths[i]);
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // ordered maps, so the result is the same whichever worker read which file
+    std::vector<Group> milestones;
+    std::map<std::string, Group> positions;
+    std::map<std::string, uint64_t> events;
+    Partial totals;
+    for (Partial& partial : partials) {
+        if (milestones.size() < partial.milestones.size()) {
+            milestones.resize(partial.milestones.size());
+        }
+        for (size_t i = 0; i < partial.milestones.size(); i++) {
+            milestones[i].merge(partial.milestones[i]);
+        }
+        for (auto& position : partial.positions) {
+            positions[position.first].merge(position.second);
+        }
+        for (const auto& event : partial.events) {
+            events[event.first] += event.second;
+        }
+        totals.files += partial.files;
+        totals.reactions += partial.reactions;
+        totals.eventRecords += partial.eventRecords;
+        totals.bytes += partial.bytes;
+        totals.failed.insert(totals.failed.end(), partial.failed.begin(), partial.failed.end());
+    }
+    for (const std::string& path : totals.failed) {
+        fprintf(stderr, "%s is not a reactions or events export\n", path.c_str());
+    }
+    if (!writeResult(outPath, milestones, positions, events)) {
+        fprintf(stderr, "can't write %s\n", outPath);
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("{\"files\":%llu,\"failed\":%zu,\"reactions\":%llu,\"events\":%llu,\"bytes\":%llu,\"jobs\":%u,"
+           "\"seconds\":%.6f,\"megabytesPerSecond\":%.1f,\"out\":",
+           static_cast<unsigned long long>(totals.files), totals.failed.size(), static_cast<unsigned long long>(totals.reactions),
+           static_cast<unsigned long long>(totals.eventRecords), static_cast<unsigned long long>(totals.bytes), jobs,
+           seconds, seconds > 0 ? totals.bytes / seconds / 1e6 : 0.0);
+    writeString(stdout, outPath);
+    printf("}\n");
+    return totals.failed.empty() ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+//
+//  main.cpp
+//  bench
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../src/main.hpp"
+
+static const long long k_nanosecondsPerMillisecond = 1000000;
+static const int k_repetitions = 5;
+
+static const char* s_filter = nullptr;
+static bool s_stimulusPending = false;
+
+static void handlerFunc() {
+    s_stimulusPending = true;
+}
+
+static void stopHandlerFunc() {
+    s_stimulusPending = false;
+}
+
+static void logFunc(const char*) {
+}
+
+static long long elapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One warm up run, then k_repetitions timed ones. run() does its own setup and returns the
+// nanoseconds spent on the measured part; operations is how many calls that part made.
+// Prints one JSON object per line, so the output can be diffed against a baseline run.
+template <typename Run>
+static void measure(const char* name, long long records, long long operations, Run run) {
+    if (s_filter != nullptr && strstr(name, s_filter) == nullptr) {
+        return;
+    }
+    run();
+    std::vector<double> nsPerOperation;
+    for (int i = 0; i < k_repetitions; i++) {
+        nsPerOperation.push_back(static_cast<double>(run()) / operations);
+    }
+    std::sort(nsPerOperation.begin(), nsPerOperation.end());
+    printf("{\"benchmark\":\"%s\",\"records\":%lld,\"operations\":%lld,\"repetitions\":%d,"
+           "\"nsPerOpMin\":%.1f,\"nsPerOpMedian\":%.1f,\"nsPerOpMax\":%.1f}\n",
+           name, records, operations, k_repetitions,
+           nsPerOperation.front(), nsPerOperation[nsPerOperation.size() / 2], nsPerOperation.back());
+    fflush(stdout);
+}
+
+// Virtual session whose stimulus comes every second, so trials run back to back.
+static SessionHandle createTrialSession(void (*debugLogHandler)(const char*), int logLevel) {
+    SessionHandle session = createVirtualSession();
+    sessionInitializeStimulusHandler(session, handlerFunc, stopHandlerFunc, debugLogHandler);
+    sessionSetLogLevel(session, logLevel);
+    sessionSetUniformSchedule(session, 1000, 1000);
+    sessionStartMeasurement(session);
+    return session;
+}
+
+// Stimulus, response and the transitions in between: five events through processEvent.
+static void runTrials(SessionHandle session, long long trials) {
+    for (long long i = 0; i < trials; i++) {
+        sessionAdvanceToNextDeadline(session);
+        sessionAdvanceClock(session, 300 * k_nanosecondsPerMillisecond);
+        sessionRespondToStimulus(session, (i & 1) != 0 ? "left" : "right");
+    }
+}
+
+static void benchmarkTrials(const char* name, void (*debugLogHandler)(const char*), int logLevel) {
+    const long long trials = 100000;
+    measure(name, 0, trials, [=]{
+        SessionHandle session = createTrialSession(debugLogHandler, logLevel);
+        auto start = std::chrono::steady_clock::now();
+        runTrials(session, trials);
+        long long elapsed = elapsedSince(start);
+        destroySession(session);
+        return elapsed;
+    });
+}
+
+// Real time session, so this includes the hand over to the executor thread. The measurement
+// ends once every call has been executed.
+template <typename Call>
+static void benchmarkSubmission(const char* name, void (*debugLogHandler)(const char*), Call call) {
+    const long long calls = 200000;
+    measure(name, 0, calls, [=]{
+        SessionHandle session = createSession();
+        sessionInitializeStimulusHandler(session, handlerFunc, stopHandlerFunc, debugLogHandler);
+        sessionStartMeasurement(session);
+        sessionDrainDebugLog(session);
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < calls; i++) {
+            call(session, i);
+        }
+        sessionDrainDebugLog(session);
+        long long elapsed = elapsedSince(start);
+        destroySession(session);
+        return elapsed;
+    });
+}
+
+static void benchmarkExports(long long records) {
+    if (s_filter != nullptr && strstr("export_reactions_json export_events_json export_binary request_export_events", s_filter) == nullptr) {
+        return; // skip building the session
+    }
+    SessionHandle session = createTrialSession(nullptr, 0);
+    runTrials(session, records);
+    for (long long i = 0; i < records; i++) {
+        sessionAddEventLog(session, (i & 1) != 0 ? "lap" : "checkpoint");
+    }
+
+    measure("export_reactions_json", records, 1, [=]{
+        auto start = std::chrono::steady_clock::now();
+        freeExportedData(sessionExportReactionData(session));
+        return elapsedSince(start);
+    });
+    measure("export_events_json", records, 1, [=]{
+        auto start = std::chrono::steady_clock::now();
+        freeExportedData(sessionExportEventsData(session));
+        return elapsedSince(start);
+    });
+    measure("export_binary", records, 1, [=]{
+        size_t size;
+        auto start = std::chrono::steady_clock::now();
+        freeExportedData(sessionExportBinary(session, &size));
+        return elapsedSince(start);
+    });
+    // What the host's thread pays for a background export; the serialisation isn't timed.
+    measure("request_export_events", records, 1, [=]{
+        auto start = std::chrono::steady_clock::now();
+        ExportRequest request = sessionRequestExport(session, ExportEvents, 0, nullptr, nullptr);
+        long long elapsed = elapsedSince(start);
+        char* data = nullptr;
+        while (sessionPollExport(session, request, &data, nullptr, nullptr) == ExportPending) {
+        }
+        freeExportedData(data);
+        return elapsed;
+    });
+    destroySession(session);
+}
+
+// Micro benchmarks of the plugin's C API: bench [max records] [name filter]
+int main(int argc, const char * argv[]) {
+    long long maxRecords = 1000000;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+            maxRecords = atoll(argv[i]);
+        } else {
+            s_filter = argv[i];
+        }
+    }
+
+    // processEvent dispatch, and what the debug log adds to it: no handler, every message
+    // filtered out by the level, and every message formatted and delivered (virtual sessions
+    // deliver on the calling thread).
+    benchmarkTrials("process_event_trial", nullptr, 4);
+    benchmarkTrials("process_event_trial_log_filtered", logFunc, 0);
+    benchmarkTrials("process_event_trial_log_trace", logFunc, 4);
+
+    benchmarkSubmission("respond_to_stimulus", nullptr, [](SessionHandle session, long long i) {
+        sessionRespondToStimulus(session, (i & 1) != 0 ? "left" : "right");
+    });
+    benchmarkSubmission("respond_to_stimulus_log_trace", logFunc, [](SessionHandle session, long long i) {
+        sessionRespondToStimulus(session, (i & 1) != 0 ? "left" : "right");
+    });
+    benchmarkSubmission("add_event_log", nullptr, [](SessionHandle session, long long) {
+        sessionAddEventLog(session, "event");
+    });
+    benchmarkSubmission("add_telemetry_event", nullptr, [](SessionHandle session, long long i) {
+        float pose[7] = {static_cast<float>(i), 1.6f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+        sessionAddTelemetryEvent(session, 1, pose, 7);
+    });
+    // one frame's worth of samples per call
+    benchmarkSubmission("add_event_log_batch_4", nullptr, [](SessionHandle session, long long i) {
+        TelemetryEvent frame[4] = {};
+        for (unsigned id = 0; id < 4; id++) {
+            frame[id].id = id;
+            frame[id].fieldCount = 7;
+            frame[id].fields[0] = static_cast<float>(i);
+        }
+        sessionAddEventLogBatch(session, frame, 4);
+    });
+
+    for (long long records = 1000; records <= maxRecords; records *= 10) {
+        benchmarkExports(records);
+    }
+    return 0;
+}
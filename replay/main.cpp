@@ -0,0 +1,274 @@
+//
+//  main.cpp
+//  replay
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/BinaryFormat.hpp"
+#include "../src/CallTrace.hpp"
+#include "../src/JsonWriter.hpp"
+#include "../src/main.hpp"
+
+using CallTraceFormat::Record;
+
+enum Pacing {
+    Simulated,      // virtual session, the trace's timing replayed on a simulated clock
+    Original,       // real time session, calls spaced as they were recorded
+    Flat            // real time session, calls back to back
+};
+
+static void signalHandler() {
+}
+
+static void signalStopHandler() {
+}
+
+// Reactions, events and any telemetry of the measurement that is about to be stopped, one export per line.
+static void appendExports(SessionHandle session, std::string& output) {
+    char* reactions = sessionExportReactionData(session);
+    char* events = sessionExportEventsData(session);
+    char* telemetry = sessionExportTelemetryData(session);
+    output.append(reactions).append("\n").append(events).append("\n");
+    if (strcmp(telemetry, "[]") != 0) {
+        output.append(telemetry).append("\n");
+    }
+    freeExportedData(reactions);
+    freeExportedData(events);
+    freeExportedData(telemetry);
+}
+
+// channel is the one the trace's last SelectChannel picked.
+static void replayCall(SessionHandle session, const Record& record, unsigned& channel, std::string& output) {
+    std::string text(reinterpret_cast<const char*>(record.payload), record.payloadSize);
+    uint64_t values[3] = {};
+    switch (record.call) {
+        case CallTraceFormat::StartMeasurement:
+            sessionStartMeasurement(session);
+            break;
+        case CallTraceFormat::RespondToStimulus:
+            sessionChannelRespondToStimulus(session, channel, text.c_str());
+            break;
+        case CallTraceFormat::AddMilestone:
+            sessionAddMilestone(session);
+            break;
+        case CallTraceFormat::AddEventLog:
+            sessionAddEventLog(session, text.c_str());
+            break;
+        case CallTraceFormat::StopMeasurement:
+            appendExports(session, output);
+            sessionStopMeasurement(session);
+            break;
+        case CallTraceFormat::SetStimulusSeed:
+            if (record.numbers(values, 1)) {
+                sessionSetStimulusSeed(session, values[0]);
+            }
+            break;
+        case CallTraceFormat::SetUniformSchedule:
+            if (record.numbers(values, 2)) {
+                sessionChannelSetUniformSchedule(session, channel, static_cast<unsigned>(values[0]), static_cast<unsigned>(values[1]));
+            }
+            break;
+        case CallTraceFormat::SetExponentialSchedule:
+            if (record.numbers(values, 3)) {
+                sessionChannelSetExponentialSchedule(session, channel, static_cast<unsigned>(values[0]), static_cast<unsigned>(values[1]),
+                                                     static_cast<unsigned>(values[2]));
+            }
+            break;
+        case CallTraceFormat::SetScheduleList: {
+            std::vector<uint64_t> numbers(1);
+            if (!record.numbers(numbers.data(), 1) || numbers[0] > record.payloadSize) {
+                break;
+            }
+            numbers.resize(1 + numbers[0]);
+            if (record.numbers(numbers.data(), numbers.size())) {
+                std::vector<unsigned> intervals(numbers.begin() + 1, numbers.end());
+                sessionChannelSetScheduleList(session, channel, intervals.data(), intervals.size());
+            }
+            break;
+        }
+        case CallTraceFormat::AddTelemetry: {
+            std::vector<TelemetryEvent> events;
+            const unsigned char* p = record.payload;
+            const unsigned char* end = record.payload + record.payloadSize;
+            uint64_t count;
+            if (!CallTraceFormat::loadVarint(p, end, count) || count > record.payloadSize) {
+                break;
+            }
+            events.resize(static_cast<size_t>(count));
+            bool complete = true;
+            for (TelemetryEvent& event : events) {
+                uint64_t id = 0;
+                uint64_t fieldCount = 0;
+                complete = CallTraceFormat::loadVarint(p, end, id) && CallTraceFormat::loadVarint(p, end, fieldCount) && fieldCount <= 8;
+                if (!complete) {
+                    break;
+                }
+                event.id = static_cast<unsigned>(id);
+                event.fieldCount = static_cast<unsigned>(fieldCount);
+                for (unsigned field = 0; field < event.fieldCount; field++) {
+                    uint64_t bits = 0;
+                    if (!CallTraceFormat::loadVarint(p, end, bits)) {
+                        complete = false;
+                        break;
+                    }
+                    uint32_t bits32 = static_cast<uint32_t>(bits);
+                    memcpy(&event.fields[field], &bits32, sizeof(bits32));
+                }
+                if (!complete) {
+                    break;
+                }
+            }
+            if (complete) {
+                sessionAddEventLogBatch(session, events.data(), events.size());
+            }
+            break;
+        }
+        case CallTraceFormat::AddChannel: {
+            int added = sessionAddStimulusChannel(session);
+            if (added >= 0) {
+                sessionChannelInitializeStimulusHandler(session, static_cast<unsigned>(added), signalHandler, signalStopHandler);
+            }
+            break;
+        }
+        case CallTraceFormat::SelectChannel:
+            if (record.numbers(values, 1)) {
+                channel = static_cast<unsigned>(values[0]);
+            }
+            break;
+        case CallTraceFormat::SetResponseTimeout:
+            if (record.numbers(values, 1)) {
+                sessionChannelSetResponseTimeout(session, channel, static_cast<unsigned>(values[0]));
+            }
+            break;
+        case CallTraceFormat::TraceStopped:
+            break;
+    }
+}
+
+// Line and column of the first difference, or false if both are the same.
+static bool findDifference(const std::string& a, const std::string& b, size_t& line, size_t& column) {
+    size_t length = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < length && a[i] == b[i]) {
+        i++;
+    }
+    if (i == a.size() && i == b.size()) {
+        return false;
+    }
+    line = static_cast<size_t>(std::count(a.begin(), a.begin() + i, '\n')) + 1;
+    size_t lineStart = i == 0 ? std::string::npos : a.rfind('\n', i - 1);
+    column = lineStart == std::string::npos ? i + 1 : i - lineStart;
+    return true;
+}
+
+// Quoted and escaped as the exports write strings.
+static std::string jsonString(const char* text) {
+    JsonWriter measure(nullptr, 0);
+    measure.string(text);
+    std::string quoted(measure.size(), '\0');
+    JsonWriter writer(&quoted[0], quoted.size());
+    writer.string(text);
+    return quoted;
+}
+
+static double percentile(const std::vector<long long>& sorted, double quantile) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return static_cast<double>(sorted[static_cast<size_t>(quantile * (sorted.size() - 1))]);
+}
+
+// Replays a trace written by startTrace: replay trace [--paced | --flat] [--out file] [--compare file]
+// By default on a virtual session, as fast as possible and deterministic. --paced replays on a real
+// time session at the recorded pace, --flat on a real time session with no pauses. Prints one JSON
+// object with the throughput, the latency of the calls and whether the exports match --compare.
+int main(int argc, const char * argv[]) {
+    const char* tracePath = nullptr;
+    const char* outPath = nullptr;
+    const char* comparePath = nullptr;
+    Pacing pacing = Simulated;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--paced") == 0) {
+            pacing = Original;
+        } else if (strcmp(argv[i], "--flat") == 0) {
+            pacing = Flat;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            comparePath = argv[++i];
+        } else {
+            tracePath = argv[i];
+        }
+    }
+    if (tracePath == nullptr) {
+        fprintf(stderr, "usage: replay trace [--paced | --flat] [--out file] [--compare file]\n");
+        return 2;
+    }
+
+    BinaryFormat::MappedFile file(tracePath);
+    CallTraceFormat::Reader reader;
+    if (!reader.open(file.data(), file.size())) {
+        fprintf(stderr, "%s is not a call trace\n", tracePath);
+        return 1;
+    }
+
+    SessionHandle session = pacing == Simulated ? createVirtualSession() : createSession();
+    sessionInitializeStimulusHandler(session, signalHandler, signalStopHandler, nullptr);
+
+    std::string output;
+    std::vector<long long> latencies;
+    Record record;
+    unsigned channel = 0;
+    int64_t clock = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (reader.next(record)) {
+        if (pacing == Simulated && record.time > clock) {
+            sessionAdvanceClock(session, record.time - clock);
+            clock = record.time;
+        } else if (pacing == Original) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.time));
+        }
+        auto callStart = std::chrono::steady_clock::now();
+        replayCall(session, record, channel, output);
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - callStart).count());
+    }
+    appendExports(session, output); // also waits for the real time session to catch up
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    destroySession(session);
+
+    if (outPath != nullptr) {
+        std::ofstream(outPath, std::ios::binary) << output;
+    }
+    std::string comparison = "\"not compared\"";
+    if (comparePath != nullptr) {
+        std::ifstream expectedFile(comparePath, std::ios::binary);
+        std::string expected((std::istreambuf_iterator<char>(expectedFile)), std::istreambuf_iterator<char>());
+        size_t line;
+        size_t column;
+        if (!expectedFile.is_open()) {
+            comparison = "\"missing\"";
+        } else if (findDifference(output, expected, line, column)) {
+            comparison = "{\"differsAtLine\":" + std::to_string(line) + ",\"column\":" + std::to_string(column) + "}";
+        } else {
+            comparison = "\"identical\"";
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("{\"trace\":%s,\"pacing\":\"%s\",\"calls\":%zu,\"seconds\":%.6f,\"callsPerSecond\":%.1f,"
+           "\"latencyNs\":{\"p50\":%.0f,\"p90\":%.0f,\"p99\":%.0f,\"max\":%.0f},\"output\":%s}\n",
+           jsonString(tracePath).c_str(), pacing == Simulated ? "simulated" : pacing == Original ? "paced" : "flat",
+           latencies.size(), seconds, seconds > 0 ? latencies.size() / seconds : 0.0,
+           percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99), percentile(latencies, 1.0),
+           comparison.c_str());
+    return comparison.find("differs") != std::string::npos ? 3 : 0;
+}
@@ -0,0 +1,159 @@
+//
+//  BinaryExport.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "BinaryExport.hpp"
+
+#include "BinaryFormat.hpp"
+
+#include <vector>
+
+using namespace BinaryFormat;
+
+static size_t aligned(size_t size) {
+    return (size + k_alignment - 1) & ~(k_alignment - 1);
+}
+
+static size_t headerSize() {
+    return aligned(k_fixedHeaderSize + ColumnCount * k_directoryEntrySize);
+}
+
+// Lays out the Strings column: position names in id order, then event names, each distinct
+// string stored once. Only measures when text is null, otherwise also fills the Strings
+// column and the offset columns.
+static uint64_t layoutStrings(const SessionStore::Snapshot& snapshot, unsigned char* text, unsigned char* positionNames, unsigned char* eventNames) {
+    StringInterner offsets;
+    uint64_t size = 0;
+    auto place = [&](const char* name) -> uint32_t {
+        size_t length = strlen(name);
+        uint32_t hash = StringInterner::hash(name, length);
+        uint32_t offset = offsets.find(name, length, hash);
+        if (offset == StringInterner::k_notFound) {
+            offset = static_cast<uint32_t>(size);
+            offsets.insert(offset, name, hash);   // the snapshot keeps name alive
+            if (text != nullptr) {
+                memcpy(text + size, name, length + 1);
+            }
+            size += length + 1;
+        }
+        return offset;
+    };
+
+    for (size_t id = snapshot.positions.begin(); id < snapshot.positions.end(); id++) {
+        uint32_t offset = place(snapshot.position(static_cast<uint32_t>(id)));
+        if (text != nullptr) {
+            storeU32(positionNames + (id - snapshot.positions.begin()) * 4, offset);
+        }
+        if (size > UINT32_MAX) {
+            return size;
+        }
+    }
+    // event names are interned, so each is placed once and then looked up by id
+    std::vector<uint32_t> nameOffsets(snapshot.eventNames.size(), StringInterner::k_notFound);
+    size_t row = 0;
+    snapshot.events.forEachChunk([&](const EventChunk& chunk, size_t firstSlot, size_t endSlot) {
+        for (size_t slot = firstSlot; slot < endSlot && size <= UINT32_MAX; slot++, row++) {
+            uint32_t& offset = nameOffsets[chunk.name[slot]];
+            if (offset == StringInterner::k_notFound) {
+                offset = place(snapshot.eventName(chunk.name[slot]));
+            }
+            if (text != nullptr) {
+                storeU32(eventNames + row * 4, offset);
+            }
+        }
+    });
+    return size;
+}
+
+// Byte sizes of every column, in Column order.
+static void columnSizes(const SessionStore::Snapshot& snapshot, uint64_t strings, uint64_t* sizes) {
+    uint64_t reactions = snapshot.reactions.size();
+    uint64_t events = snapshot.events.size();
+    sizes[ReactionSinceStart] = reactions * 8;
+    sizes[ReactionTime] = reactions * 8;
+    sizes[ReactionCallbackDuration] = reactions * 8;
+    sizes[ReactionMilestone] = reactions * 4;
+    sizes[ReactionPosition] = reactions * 4;
+    sizes[EventSinceStart] = events * 8;
+    sizes[EventMilestone] = events * 4;
+    sizes[EventName] = events * 4;
+    sizes[PositionName] = snapshot.positions.size() * 4;
+    sizes[Strings] = strings;
+    sizes[ReactionChannel] = reactions * 4;
+    sizes[BinaryFormat::ReactionOutcome] = reactions * 4;   // qualified, SessionStore.hpp has a ReactionOutcome too
+}
+
+size_t binaryExportSize(const SessionStore::Snapshot& snapshot) {
+    uint64_t strings = layoutStrings(snapshot, nullptr, nullptr, nullptr);
+    if (strings > UINT32_MAX) {
+        return 0;
+    }
+    uint64_t sizes[ColumnCount];
+    columnSizes(snapshot, strings, sizes);
+    size_t size = headerSize();
+    for (uint32_t c = 0; c < ColumnCount; c++) {
+        size += aligned(sizes[c]);
+    }
+    return size;
+}
+
+void writeBinaryExport(unsigned char* output, const SessionStore::Snapshot& snapshot) {
+    uint64_t strings = layoutStrings(snapshot, nullptr, nullptr, nullptr);
+    uint64_t sizes[ColumnCount];
+    columnSizes(snapshot, strings, sizes);
+    uint64_t offsets[ColumnCount];
+    size_t headerBytes = headerSize();
+    memset(output, 0, headerBytes);
+
+    memcpy(output, k_magic, 4);
+    storeU16(output + 4, k_version);
+    storeU16(output + 6, static_cast<uint16_t>(k_fixedHeaderSize + ColumnCount * k_directoryEntrySize));
+    storeU32(output + 8, ColumnCount);
+    storeU32(output + 12, 0);
+    storeU64(output + 16, snapshot.reactions.size());
+    storeU64(output + 24, snapshot.events.size());
+    storeU64(output + 32, snapshot.positions.size());
+    uint64_t offset = headerBytes;
+    for (uint32_t c = 0; c < ColumnCount; c++) {
+        offsets[c] = offset;
+        storeU64(output + k_fixedHeaderSize + c * k_directoryEntrySize, offset);
+        storeU64(output + k_fixedHeaderSize + c * k_directoryEntrySize + 8, sizes[c]);
+        // zero the alignment padding so exports of equal data are byte identical
+        memset(output + offset + sizes[c], 0, aligned(sizes[c]) - sizes[c]);
+        offset += aligned(sizes[c]);
+    }
+
+    // one pass per log, filling all of its columns, so each sealed chunk is decoded once
+    unsigned char* reactionSinceStart = output + offsets[ReactionSinceStart];
+    unsigned char* reactionTime = output + offsets[ReactionTime];
+    unsigned char* reactionCallbackDuration = output + offsets[ReactionCallbackDuration];
+    unsigned char* reactionMilestone = output + offsets[ReactionMilestone];
+    unsigned char* reactionPosition = output + offsets[ReactionPosition];
+    unsigned char* reactionChannel = output + offsets[ReactionChannel];
+    unsigned char* reactionOutcome = output + offsets[BinaryFormat::ReactionOutcome];
+    size_t row = 0;
+    snapshot.reactions.forEachChunk([&](const ReactionChunk& chunk, size_t firstSlot, size_t endSlot) {
+        for (size_t slot = firstSlot; slot < endSlot; slot++, row++) {
+            storeU64(reactionSinceStart + row * 8, static_cast<uint64_t>(chunk.sinceStart[slot]));
+            storeU64(reactionTime + row * 8, static_cast<uint64_t>(chunk.reactionTime[slot]));
+            storeU64(reactionCallbackDuration + row * 8, static_cast<uint64_t>(chunk.callbackDuration[slot]));
+            storeU32(reactionMilestone + row * 4, chunk.milestone[slot]);
+            storeU32(reactionPosition + row * 4, chunk.position[slot]);
+            storeU32(reactionChannel + row * 4, chunk.channel[slot]);
+            storeU32(reactionOutcome + row * 4, chunk.outcome[slot]);
+        }
+    });
+
+    unsigned char* eventSinceStart = output + offsets[EventSinceStart];
+    unsigned char* eventMilestone = output + offsets[EventMilestone];
+    row = 0;
+    snapshot.events.forEachChunk([&](const EventChunk& chunk, size_t firstSlot, size_t endSlot) {
+        for (size_t slot = firstSlot; slot < endSlot; slot++, row++) {
+            storeU64(eventSinceStart + row * 8, static_cast<uint64_t>(chunk.sinceStart[slot]));
+            storeU32(eventMilestone + row * 4, chunk.milestone[slot]);
+        }
+    });
+
+    layoutStrings(snapshot, output + offsets[Strings], output + offsets[PositionName], output + offsets[EventName]);
+}
@@ -0,0 +1,21 @@
+//
+//  BinaryExport.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef BinaryExport_hpp
+#define BinaryExport_hpp
+
+#include "SessionStore.hpp"
+
+// Writer for the column oriented export described in BinaryFormat.hpp.
+// The size is known from the record counts and string lengths up front, so
+// the output is written exactly once with no intermediate copies.
+
+// Bytes the export of snapshot takes, or 0 if its distinct strings outgrow the format's 32 bit offsets.
+size_t binaryExportSize(const SessionStore::Snapshot& snapshot);
+
+// Writes the export into output, which must hold binaryExportSize(snapshot) bytes.
+void writeBinaryExport(unsigned char* output, const SessionStore::Snapshot& snapshot);
+
+#endif /* BinaryExport_hpp */
@@ -0,0 +1,276 @@
+//
+//  BinaryFormat.hpp
+//  SecondaryTaskPlugin
+//
+//  Layout of the binary session export plus a reader for it. Header only and
+//  free of plugin dependencies, so analysis tools can include it on its own.
+//
+
+#ifndef BinaryFormat_hpp
+#define BinaryFormat_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// All integers are little-endian. The file is
+//
+//   offset  0  char[4]  magic "STYB"
+//           4  u16      version
+//           6  u16      header size in bytes (directory included)
+//           8  u32      column count
+//          12  u32      flags, currently 0
+//          16  u64      reaction count
+//          24  u64      event count
+//          32  u64      position count
+//          40  column directory: column count x { u64 offset, u64 byte size }
+//
+// followed by the columns, each starting on an 8 byte boundary. Times are
+// microseconds since the measurement started. Strings are NUL terminated UTF-8
+// inside the Strings column and are referenced by their offset in it; equal
+// strings may share one copy. Columns may be added after the known ones without
+// bumping the version; readers skip the ones they don't know.
+namespace BinaryFormat {
+
+static const char k_magic[4] = {'S', 'T', 'Y', 'B'};
+static const uint16_t k_version = 1;
+static const size_t k_fixedHeaderSize = 40;
+static const size_t k_directoryEntrySize = 16;
+static const size_t k_alignment = 8;
+
+enum Column : uint32_t {
+    ReactionSinceStart,         // i64 per reaction
+    ReactionTime,               // i64 per reaction
+    ReactionCallbackDuration,   // i64 per reaction
+    ReactionMilestone,          // u32 per reaction
+    ReactionPosition,           // u32 per reaction, index into the position columns
+    EventSinceStart,            // i64 per event
+    EventMilestone,             // u32 per event
+    EventName,                  // u32 per event, offset into Strings
+    PositionName,               // u32 per position, offset into Strings
+    Strings,                    // bytes
+    ReactionChannel,            // u32 per reaction, stimulus channel index; absent from older files
+    ReactionOutcome,            // u32 per reaction, 0 response, 1 timeout, 2 false start; absent from older files
+    ColumnCount
+};
+
+// Files written before a column was added stop at this many.
+static const uint32_t k_minColumnCount = ReactionChannel;
+
+inline uint16_t loadU16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t loadU32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t loadU64(const unsigned char* p) {
+    return static_cast<uint64_t>(loadU32(p)) | (static_cast<uint64_t>(loadU32(p + 4)) << 32);
+}
+
+inline void storeU16(unsigned char* p, uint16_t value) {
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+}
+
+inline void storeU32(unsigned char* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+inline void storeU64(unsigned char* p, uint64_t value) {
+    storeU32(p, static_cast<uint32_t>(value));
+    storeU32(p + 4, static_cast<uint32_t>(value >> 32));
+}
+
+// Read only view over an export held in memory. Accessors decode straight from
+// the bytes, nothing is copied. Check valid() before using anything else; in a
+// valid file every string offset and position id is in bounds.
+class Reader {
+public:
+    Reader(const void* data, size_t size) : _data(static_cast<const unsigned char*>(data)), _size(size) {
+        _valid = validate();
+    }
+
+    bool valid() const { return _valid; }
+    uint16_t version() const { return loadU16(_data + 4); }
+
+    uint64_t reactionCount() const { return loadU64(_data + 16); }
+    uint64_t eventCount() const { return loadU64(_data + 24); }
+    uint64_t positionCount() const { return loadU64(_data + 32); }
+
+    int64_t reactionSinceStart(uint64_t i) const { return static_cast<int64_t>(loadU64(column(ReactionSinceStart) + i * 8)); }
+    int64_t reactionTime(uint64_t i) const { return static_cast<int64_t>(loadU64(column(ReactionTime) + i * 8)); }
+    int64_t reactionCallbackDuration(uint64_t i) const { return static_cast<int64_t>(loadU64(column(ReactionCallbackDuration) + i * 8)); }
+    uint32_t reactionMilestone(uint64_t i) const { return loadU32(column(ReactionMilestone) + i * 4); }
+    uint32_t reactionPosition(uint64_t i) const { return loadU32(column(ReactionPosition) + i * 4); }
+    const char* reactionPositionName(uint64_t i) const { return positionName(reactionPosition(i)); }
+    uint32_t reactionChannel(uint64_t i) const { return hasColumn(ReactionChannel) ? loadU32(column(ReactionChannel) + i * 4) : 0; }
+    // Files without the column only had the layout to go by: no position was a timeout, the
+    // 5 s a false start was recorded as marked one.
+    uint32_t reactionOutcome(uint64_t i) const {
+        if (hasColumn(ReactionOutcome)) {
+            return loadU32(column(ReactionOutcome) + i * 4);
+        }
+        return reactionPosition(i) == 0 ? 1 : reactionTime(i) == 5000000 ? 2 : 0;
+    }
+
+    int64_t eventSinceStart(uint64_t i) const { return static_cast<int64_t>(loadU64(column(EventSinceStart) + i * 8)); }
+    uint32_t eventMilestone(uint64_t i) const { return loadU32(column(EventMilestone) + i * 4); }
+    const char* eventName(uint64_t i) const { return string(loadU32(column(EventName) + i * 4)); }
+
+    const char* positionName(uint64_t id) const { return string(loadU32(column(PositionName) + id * 4)); }
+
+    bool hasColumn(Column c) const { return c < loadU32(_data + 8); }
+
+    // Raw column bytes, for bulk scans on little-endian hosts.
+    const unsigned char* column(Column c) const { return _data + loadU64(directory(c)); }
+    uint64_t columnSize(Column c) const { return loadU64(directory(c) + 8); }
+
+private:
+    const unsigned char* directory(Column c) const { return _data + k_fixedHeaderSize + c * k_directoryEntrySize; }
+    const char* string(uint32_t offset) const { return reinterpret_cast<const char*>(column(Strings)) + offset; }
+
+    bool validate() const {
+        if (_data == nullptr || _size < k_fixedHeaderSize || memcmp(_data, k_magic, 4) != 0 || version() != k_version) {
+            return false;
+        }
+        // every row takes bytes, so larger counts can't be right and would overflow the sizes below
+        if (reactionCount() > _size || eventCount() > _size || positionCount() > _size) {
+            return false;
+        }
+        uint32_t columnCount = loadU32(_data + 8);
+        if (columnCount < k_minColumnCount || loadU16(_data + 6) < k_fixedHeaderSize + columnCount * k_directoryEntrySize ||
+            loadU16(_data + 6) > _size) {
+            return false;
+        }
+        const uint64_t rowBytes[ColumnCount] = {
+            8, 8, 8, 4, 4,      // reactions
+            8, 4, 4,            // events
+            4,                  // positions
+            0,
+            4, 4                // reactions
+        };
+        const uint64_t rows[ColumnCount] = {
+            reactionCount(), reactionCount(), reactionCount(), reactionCount(), reactionCount(),
+            eventCount(), eventCount(), eventCount(),
+            positionCount(),
+            0,
+            reactionCount(), reactionCount()
+        };
+        for (uint32_t c = 0; c < ColumnCount && c < columnCount; c++) {
+            uint64_t offset = loadU64(directory(static_cast<Column>(c)));
+            uint64_t size = loadU64(directory(static_cast<Column>(c)) + 8);
+            if (offset > _size || size > _size - offset || (c != Strings && size != rows[c] * rowBytes[c])) {
+                return false;
+            }
+        }
+        // any string starting inside the Strings column also ends inside it
+        uint64_t stringsSize = columnSize(Strings);
+        if (stringsSize != 0 && column(Strings)[stringsSize - 1] != '\0') {
+            return false;
+        }
+        // so every value the accessors follow is checked once here rather than on each access
+        for (uint64_t i = 0; i < reactionCount(); i++) {
+            if (reactionPosition(i) >= positionCount()) {
+                return false;
+            }
+        }
+        for (uint64_t i = 0; i < eventCount(); i++) {
+            if (loadU32(column(EventName) + i * 4) >= stringsSize) {
+                return false;
+            }
+        }
+        for (uint64_t i = 0; i < positionCount(); i++) {
+            if (loadU32(column(PositionName) + i * 4) >= stringsSize) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const unsigned char* _data;
+    size_t _size;
+    bool _valid;
+};
+
+// Maps an export file read only for the lifetime of the object.
+class MappedFile {
+public:
+    explicit MappedFile(const char* path) : _data(nullptr), _size(0) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                _data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                _size = _data != nullptr ? static_cast<size_t>(size.QuadPart) : 0;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = open(path, O_RDONLY);
+        if (file < 0) {
+            return;
+        }
+        struct stat status;
+        if (fstat(file, &status) == 0 && status.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED) {
+                _data = data;
+                _size = static_cast<size_t>(status.st_size);
+            }
+        }
+        close(file);
+#endif
+    }
+
+    ~MappedFile() {
+        if (_data == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(_data);
+#else
+        munmap(_data, _size);
+#endif
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    const void* data() const { return _data; }
+    size_t size() const { return _size; }
+    Reader reader() const { return Reader(_data, _size); }
+
+private:
+    void* _data;
+    size_t _size;
+};
+
+} // namespace BinaryFormat
+
+#endif /* BinaryFormat_hpp */
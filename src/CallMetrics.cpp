@@ -0,0 +1,120 @@
+//
+//  CallMetrics.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "CallMetrics.hpp"
+
+// Gives the thread's shard back when the thread exits.
+struct CallMetrics::ShardOwner {
+    Shard* shard = nullptr;
+
+    ~ShardOwner() {
+        if (shard != nullptr) {
+            Registry& shards = registry();
+            std::lock_guard<std::mutex> lock(shards.mutex);
+            shards.released.push_back(shard);
+        }
+    }
+};
+
+void CallMetrics::Shard::Counters::clear() {
+    calls.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+CallMetrics::Shard::Shard() {
+    for (Counters& counters : entryPoints) {
+        counters.clear();
+    }
+    for (auto& event : transitions) {
+        for (Counters& counters : event) {
+            counters.clear();
+        }
+    }
+    assertStates.store(0, std::memory_order_relaxed);
+}
+
+CallMetrics::Registry& CallMetrics::registry() {
+    // Leaked like the other singletons: threads may still count while the plugin unloads.
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+CallMetrics::Shard& CallMetrics::shard() {
+    static thread_local ShardOwner owner;
+    if (owner.shard == nullptr) {
+        Registry& shards = registry();
+        std::lock_guard<std::mutex> lock(shards.mutex);
+        if (!shards.released.empty()) {
+            owner.shard = shards.released.back();
+            shards.released.pop_back();
+        } else {
+            owner.shard = new Shard();
+            shards.shards.push_back(owner.shard);
+        }
+    }
+    return *owner.shard;
+}
+
+void CallMetrics::record(Shard::Counters& counters, int64_t nanoseconds) {
+    if (nanoseconds < 0) {
+        nanoseconds = 0;
+    }
+    increment(counters.buckets[Buckets::index(nanoseconds)]);
+    counters.sum.store(counters.sum.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds > counters.maximum.load(std::memory_order_relaxed)) {
+        counters.maximum.store(nanoseconds, std::memory_order_relaxed);
+    }
+    // last, with release, so a reader that sees the call sees its bucket
+    counters.calls.store(counters.calls.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void CallMetrics::add(Latency& latency, const Shard::Counters& counters) {
+    latency.calls += counters.calls.load(std::memory_order_acquire);
+    latency.sum += counters.sum.load(std::memory_order_relaxed);
+    int64_t maximum = counters.maximum.load(std::memory_order_relaxed);
+    if (maximum > latency.maximum) {
+        latency.maximum = maximum;
+    }
+    for (size_t bucket = 0; bucket < k_bucketCount; bucket++) {
+        latency.buckets[bucket] += counters.buckets[bucket].load(std::memory_order_relaxed);
+    }
+}
+
+void CallMetrics::recordCall(int entryPoint, int64_t nanoseconds) {
+    if (entryPoint < 0 || static_cast<size_t>(entryPoint) >= k_maxEntryPoints) {
+        return;
+    }
+    record(shard().entryPoints[entryPoint], nanoseconds);
+}
+
+void CallMetrics::recordTransition(int event, int state, int64_t nanoseconds) {
+    record(shard().transitions[event][state], nanoseconds);
+}
+
+void CallMetrics::countAssertState() {
+    increment(shard().assertStates);
+}
+
+void CallMetrics::snapshot(Snapshot& snapshot) {
+    snapshot = Snapshot();
+    Registry& shards = registry();
+    std::lock_guard<std::mutex> lock(shards.mutex);
+    snapshot.seconds = std::chrono::duration<double>(Clock::now() - shards.start).count();
+    for (const Shard* shard : shards.shards) {
+        for (size_t i = 0; i < k_maxEntryPoints; i++) {
+            add(snapshot.entryPoints[i], shard->entryPoints[i]);
+        }
+        for (size_t event = 0; event < k_eventCount; event++) {
+            for (size_t state = 0; state < k_stateCount; state++) {
+                add(snapshot.transitions[event][state], shard->transitions[event][state]);
+            }
+        }
+        snapshot.assertStates += shard->assertStates.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,116 @@
+//
+//  CallMetrics.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef CallMetrics_hpp
+#define CallMetrics_hpp
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "TimingHistogram.hpp"
+
+// Always-on call counters of the whole plugin: how often each API entry point ran and how
+// long it took, and how often each state machine transition ran on the executors and how
+// long its work took. Every thread counts into a shard of its own, so recording is a few
+// relaxed stores without contention; a snapshot adds the shards up.
+class CallMetrics {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t k_maxEntryPoints = 32;
+    // Power of two buckets: coarser than the session timings, as every shard holds a set per
+    // entry point and transition.
+    typedef LogLinearBuckets<0> Buckets;
+    static const size_t k_bucketCount = Buckets::k_count;
+    static const size_t k_eventCount = 6;
+    static const size_t k_stateCount = 5;
+
+    struct Latency {
+        uint64_t calls = 0;
+        int64_t sum = 0;
+        int64_t maximum = 0;
+        uint64_t buckets[k_bucketCount] = {};
+
+        double mean() const { return calls > 0 ? static_cast<double>(sum) / calls : 0; }
+        // Middle of the bucket holding the quantile, capped at the maximum.
+        int64_t quantile(double quantile) const { return Buckets::quantile(buckets, maximum, quantile); }
+    };
+
+    struct Snapshot {
+        double seconds = 0;                                         // since the first counted call
+        Latency entryPoints[k_maxEntryPoints];
+        Latency transitions[k_eventCount][k_stateCount];           // [event][state it arrived in]
+        uint64_t assertStates = 0;                                  // events the state had no transition for
+    };
+
+    // Times its scope and counts it as a call of entryPoint.
+    class Scope {
+    public:
+        explicit Scope(int entryPoint) : _entryPoint(entryPoint), _start(Clock::now()) {}
+        ~Scope() { recordCall(_entryPoint, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start).count()); }
+
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+
+    private:
+        int _entryPoint;
+        Clock::time_point _start;
+    };
+
+    static void recordCall(int entryPoint, int64_t nanoseconds);
+    // Executor only: the work of one transition of event from state.
+    static void recordTransition(int event, int state, int64_t nanoseconds);
+    static void countAssertState();
+
+    static void snapshot(Snapshot& snapshot);
+
+private:
+    // Counters of one thread, only ever written by it. Handed on to the next new thread when
+    // its thread exits, so the totals survive and short-lived threads don't pile up shards.
+    struct Shard {
+        struct Counters {
+            std::atomic<uint64_t> calls;
+            std::atomic<int64_t> sum;
+            std::atomic<int64_t> maximum;
+            std::atomic<uint64_t> buckets[k_bucketCount];
+
+            void clear();
+        };
+
+        char leadingPadding[64];    // new doesn't honour alignas before C++17, so no cache line is shared
+        Counters entryPoints[k_maxEntryPoints];
+        Counters transitions[k_eventCount][k_stateCount];
+        std::atomic<uint64_t> assertStates;
+        char trailingPadding[64];
+
+        Shard();
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<Shard*> shards;     // every shard ever made, never freed
+        std::vector<Shard*> released;   // shards of exited threads
+        Clock::time_point start = Clock::now();
+    };
+
+    struct ShardOwner;
+    friend struct ShardOwner;
+
+    static Registry& registry();
+    static Shard& shard();
+
+    static void record(Shard::Counters& counters, int64_t nanoseconds);
+    static void add(Latency& latency, const Shard::Counters& counters);
+
+    static void increment(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+#endif /* CallMetrics_hpp */
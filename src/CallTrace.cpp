@@ -0,0 +1,73 @@
+//
+//  CallTrace.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "CallTrace.hpp"
+
+#include <vector>
+
+using CallTraceFormat::k_maxVarintSize;
+using CallTraceFormat::storeVarint;
+
+static const size_t k_bufferSize = 64 * 1024;
+
+CallTrace::CallTrace(const char* path, bool virtualTime, int64_t start) :
+    _file(fopen(path, "wb")),
+    _previous(start)
+{
+    if (_file == nullptr) {
+        return;
+    }
+    setvbuf(_file, nullptr, _IOFBF, k_bufferSize);
+    unsigned char header[CallTraceFormat::k_headerSize] = {};
+    memcpy(header, CallTraceFormat::k_magic, sizeof(CallTraceFormat::k_magic));
+    header[8] = static_cast<unsigned char>(CallTraceFormat::k_version);
+    header[9] = static_cast<unsigned char>(CallTraceFormat::k_version >> 8);
+    header[10] = virtualTime ? CallTraceFormat::k_flagVirtualTime : 0;
+    fwrite(header, 1, sizeof(header), _file);
+}
+
+CallTrace::~CallTrace() {
+    if (_file != nullptr) {
+        fclose(_file);
+    }
+}
+
+void CallTrace::writeHeader(CallTraceFormat::Call call, int64_t time, size_t payloadSize) {
+    unsigned char header[1 + 2 * k_maxVarintSize];
+    size_t size = 0;
+    header[size++] = call;
+    size += storeVarint(static_cast<uint64_t>(time > _previous ? time - _previous : 0), header + size);
+    size += storeVarint(payloadSize, header + size);
+    fwrite(header, 1, size, _file);
+    if (time > _previous) {
+        _previous = time;
+    }
+}
+
+void CallTrace::writeText(CallTraceFormat::Call call, int64_t time, const char* text) {
+    if (_file == nullptr) {
+        return;
+    }
+    size_t length = text != nullptr ? strlen(text) : 0;
+    writeHeader(call, time, length);
+    if (length > 0) {
+        fwrite(text, 1, length, _file);
+    }
+}
+
+void CallTrace::writeNumbers(CallTraceFormat::Call call, int64_t time, const uint64_t* values, size_t count) {
+    if (_file == nullptr) {
+        return;
+    }
+    std::vector<unsigned char> payload(count * k_maxVarintSize);
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++) {
+        size += storeVarint(values[i], payload.data() + size);
+    }
+    writeHeader(call, time, size);
+    if (size > 0) {
+        fwrite(payload.data(), 1, size, _file);
+    }
+}
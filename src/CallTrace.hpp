@@ -0,0 +1,172 @@
+//
+//  CallTrace.hpp
+//  SecondaryTaskPlugin
+//
+//  Record of the calls a host made into a session, so its workload can be
+//  replayed against another build. The format and the reader are header only,
+//  like BinaryFormat.hpp, so the replay tool can include them on their own.
+//
+
+#ifndef CallTrace_hpp
+#define CallTrace_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// The file is
+//
+//   offset  0  char[8]  magic "STYTRACE"
+//           8  u16      version, little-endian
+//          10  u16      flags, bit 0: recorded on a virtual time session
+//          12  u32      reserved
+//
+// followed by records until the end of the file:
+//
+//   u8      call
+//   varint  nanoseconds since the previous record (the first: since the trace started)
+//   varint  payload size
+//   bytes   payload: the text of RespondToStimulus and AddEventLog (no terminator),
+//           varints for the others, nothing for calls without arguments
+//
+// Varints are LEB128: 7 bits per byte, least significant first, high bit set on
+// every byte but the last. A record cut off by a crash ends the trace.
+namespace CallTraceFormat {
+
+static const char k_magic[8] = {'S', 'T', 'Y', 'T', 'R', 'A', 'C', 'E'};
+static const uint16_t k_version = 1;
+static const size_t k_headerSize = 16;
+static const uint16_t k_flagVirtualTime = 1;
+static const size_t k_maxVarintSize = 10;
+
+enum Call : uint8_t {
+    StartMeasurement = 1,
+    RespondToStimulus,
+    AddMilestone,
+    AddEventLog,
+    StopMeasurement,
+    SetStimulusSeed,            // seed
+    SetUniformSchedule,         // min, max milliseconds
+    SetExponentialSchedule,     // min, mean, max milliseconds
+    SetScheduleList,            // count, then each interval in milliseconds
+    TraceStopped,               // when stopTrace was called, so a replay runs as long
+    AddTelemetry,               // count, then per event its id, field count and the fields' float bits
+    AddChannel,                 // a stimulus channel added, indices are assigned in order
+    SelectChannel,              // channel; RespondToStimulus, the schedules and SetResponseTimeout
+                                // apply to it from here on (channel 0 until the first one)
+    SetResponseTimeout          // milliseconds
+};
+
+inline size_t storeVarint(uint64_t value, unsigned char* out) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = static_cast<unsigned char>(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = static_cast<unsigned char>(value);
+    return size;
+}
+
+// Advances p past the varint; false if it runs past end or is too long.
+inline bool loadVarint(const unsigned char*& p, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct Record {
+    Call call;
+    int64_t time;               // nanoseconds since the trace started
+    const unsigned char* payload;
+    size_t payloadSize;
+
+    // Payload of the numeric calls; false if it holds fewer than count values.
+    bool numbers(uint64_t* values, size_t count) const {
+        const unsigned char* p = payload;
+        for (size_t i = 0; i < count; i++) {
+            if (!loadVarint(p, payload + payloadSize, values[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Walks a trace held in memory, which must outlive the reader.
+class Reader {
+public:
+    bool open(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        if (size < k_headerSize || memcmp(bytes, k_magic, sizeof(k_magic)) != 0 ||
+            (bytes[8] | (bytes[9] << 8)) != k_version) {
+            return false;
+        }
+        _flags = static_cast<uint16_t>(bytes[10] | (bytes[11] << 8));
+        _next = bytes + k_headerSize;
+        _end = bytes + size;
+        _time = 0;
+        return true;
+    }
+
+    bool isVirtualTime() const { return (_flags & k_flagVirtualTime) != 0; }
+
+    bool next(Record& record) {
+        const unsigned char* p = _next;
+        uint64_t delta;
+        uint64_t payloadSize;
+        if (p >= _end) {
+            return false;
+        }
+        record.call = static_cast<Call>(*p++);
+        if (!loadVarint(p, _end, delta) || !loadVarint(p, _end, payloadSize) ||
+            payloadSize > static_cast<uint64_t>(_end - p)) {
+            _next = _end;
+            return false;
+        }
+        _time += static_cast<int64_t>(delta);
+        record.time = _time;
+        record.payload = p;
+        record.payloadSize = static_cast<size_t>(payloadSize);
+        _next = p + payloadSize;
+        return true;
+    }
+
+private:
+    const unsigned char* _next = nullptr;
+    const unsigned char* _end = nullptr;
+    int64_t _time = 0;
+    uint16_t _flags = 0;
+};
+
+} // namespace CallTraceFormat
+
+// Writes a trace. Not thread safe: the session serialises the calls.
+class CallTrace {
+public:
+    CallTrace(const char* path, bool virtualTime, int64_t start);
+    ~CallTrace();
+
+    CallTrace(CallTrace const&) = delete;
+    CallTrace& operator=(CallTrace const&) = delete;
+
+    bool isOpen() const { return _file != nullptr; }
+
+    // time is on the session's clock, never before the previous record's.
+    void writeText(CallTraceFormat::Call call, int64_t time, const char* text);
+    void writeNumbers(CallTraceFormat::Call call, int64_t time, const uint64_t* values, size_t count);
+
+private:
+    void writeHeader(CallTraceFormat::Call call, int64_t time, size_t payloadSize);
+
+    FILE* _file;
+    int64_t _previous;
+};
+
+#endif /* CallTrace_hpp */
@@ -0,0 +1,94 @@
+//
+//  CommandQueue.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef CommandQueue_hpp
+#define CommandQueue_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// Bounded multi-producer / single-consumer ring.
+// Producers claim a cell with a single fetch_add and publish it through the
+// cell's sequence number, so push never takes a lock and never retries unless
+// the ring is completely full (then it yields until the consumer catches up).
+template <typename T, size_t Capacity>
+class CommandQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    CommandQueue() : _cells(new Cell[Capacity]) {
+        for (size_t i = 0; i < Capacity; i++) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    CommandQueue(CommandQueue const&) = delete;
+    CommandQueue& operator=(CommandQueue const&) = delete;
+
+    void push(const T& value) {
+        uint64_t position = _tail.fetch_add(1, std::memory_order_relaxed);
+        Cell& cell = _cells[position & (Capacity - 1)];
+        while (cell.sequence.load(std::memory_order_acquire) != position) {
+            std::this_thread::yield();
+        }
+        cell.value = value;
+        cell.sequence.store(position + 1, std::memory_order_release);
+    }
+
+    // Like push, but gives up instead of waiting when the ring is full.
+    bool tryPush(const T& value) {
+        uint64_t position = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[position & (Capacity - 1)];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (sequence < position) {
+                return false;   // the cell still holds the value pushed one lap ago
+            } else {
+                position = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side only.
+    bool pop(T& value) {
+        Cell& cell = _cells[_head & (Capacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return false;
+        }
+        value = cell.value;
+        cell.sequence.store(_head + Capacity, std::memory_order_release);
+        _head++;
+        return true;
+    }
+
+    // Consumer side only.
+    bool empty() const {
+        return _cells[_head & (Capacity - 1)].sequence.load(std::memory_order_acquire) != _head + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    // padded so producers bumping _tail don't keep invalidating the consumer's _head
+    std::unique_ptr<Cell[]> _cells;
+    char _padding0[64];
+    std::atomic<uint64_t> _tail{0};
+    char _padding1[64];
+    uint64_t _head = 0;
+};
+
+#endif /* CommandQueue_hpp */
@@ -0,0 +1,214 @@
+//
+//  DebugLog.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "DebugLog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+static const size_t k_maxMessage = 512;
+static const std::chrono::milliseconds k_drainInterval(20);
+
+#pragma mark - Formatting
+
+static void appendText(char* buffer, size_t capacity, size_t& used, const char* text, size_t length) {
+    size_t room = capacity - 1 - used;
+    length = std::min(length, room);
+    memcpy(buffer + used, text, length);
+    used += length;
+}
+
+// printf with the arguments taken from the record. Length modifiers in the
+// format are replaced by the ones matching how each argument was stored.
+static void formatLogRecord(const LogRecord& record, char* buffer, size_t capacity) {
+    size_t used = 0;
+    size_t argument = 0;
+    const char* p = record.format;
+    while (*p != '\0' && used + 1 < capacity) {
+        const char* percent = strchr(p, '%');
+        if (percent == nullptr) {
+            appendText(buffer, capacity, used, p, strlen(p));
+            break;
+        }
+        appendText(buffer, capacity, used, p, percent - p);
+        if (percent[1] == '%') {
+            appendText(buffer, capacity, used, "%", 1);
+            p = percent + 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        char spec[32] = "%";
+        size_t specLength = 1;
+        const char* q = percent + 1;
+        while (*q != '\0' && strchr("-+ #0123456789.", *q) != nullptr && specLength < sizeof(spec) - 4) {
+            spec[specLength++] = *q++;
+        }
+        while (*q != '\0' && strchr("hljztL", *q) != nullptr) {
+            q++;
+        }
+        char conversion = *q;
+        p = *q != '\0' ? q + 1 : q;
+        if (argument >= record.argumentCount) {
+            appendText(buffer, capacity, used, percent, p - percent);
+            continue;
+        }
+
+        uint64_t raw = record.arguments[argument];
+        uint8_t type = record.types[argument];
+        argument++;
+        char formatted[128];
+        int length = -1;
+        if ((type == LogRecord::Signed || type == LogRecord::Unsigned) && strchr("diuxXoc", conversion) != nullptr) {
+            if (conversion != 'c') {
+                spec[specLength++] = 'l';
+                spec[specLength++] = 'l';
+            }
+            spec[specLength++] = conversion;
+            spec[specLength] = '\0';
+            if (conversion == 'c') {
+                length = snprintf(formatted, sizeof(formatted), spec, static_cast<int>(raw));
+            } else if (conversion == 'd' || conversion == 'i') {
+                length = snprintf(formatted, sizeof(formatted), spec, static_cast<long long>(raw));
+            } else {
+                length = snprintf(formatted, sizeof(formatted), spec, static_cast<unsigned long long>(raw));
+            }
+        } else if (type == LogRecord::Floating && strchr("fFeEgGaA", conversion) != nullptr) {
+            double value;
+            memcpy(&value, &raw, sizeof(value));
+            spec[specLength++] = conversion;
+            spec[specLength] = '\0';
+            length = snprintf(formatted, sizeof(formatted), spec, value);
+        } else if (type == LogRecord::String && conversion == 's') {
+            const char* value = reinterpret_cast<const char*>(static_cast<uintptr_t>(raw));
+            spec[specLength++] = 's';
+            spec[specLength] = '\0';
+            length = snprintf(formatted, sizeof(formatted), spec, value != nullptr ? value : "(null)");
+        }
+        if (length < 0) {
+            appendText(buffer, capacity, used, "?", 1);
+        } else {
+            appendText(buffer, capacity, used, formatted, std::min(static_cast<size_t>(length), sizeof(formatted) - 1));
+        }
+    }
+    buffer[used] = '\0';
+}
+
+#pragma mark - Background Drainer
+
+// Single thread that drains every registered real time session's log, so
+// formatting and host callbacks never run on an executor thread.
+class LogDrainer {
+public:
+    static LogDrainer& GetInstance() {
+        // Leaked like the timer scheduler so the thread is never joined during plugin unload.
+        static LogDrainer* instance = new LogDrainer();
+        return *instance;
+    }
+
+    void add(DebugLog* log) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _logs.push_back(log);
+    }
+
+    // Returns once log is no longer being drained and never will be again.
+    void remove(DebugLog* log) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _logs.erase(std::remove(_logs.begin(), _logs.end(), log), _logs.end());
+    }
+
+private:
+    LogDrainer() : _thread(&LogDrainer::run, this) {}
+
+    void run() {
+        LogBatch batch;
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            for (DebugLog* log : _logs) {
+                log->collect(batch);
+            }
+            lock.unlock();
+            batch.deliver();
+            lock.lock();
+            _wakeUp.wait_for(lock, k_drainInterval);
+        }
+    }
+
+    std::mutex _mutex;      // held while collecting, so remove() waits for a collection in progress
+    std::condition_variable _wakeUp;
+    std::vector<DebugLog*> _logs;
+    std::thread _thread;
+};
+
+#pragma mark - Debug Log
+
+DebugLog::DebugLog() :
+    _callback(nullptr),
+    _level(LogLevel::Trace),
+    _dropped(0),
+    _backgroundDrain(false)
+{
+}
+
+DebugLog::~DebugLog() {
+    if (_backgroundDrain) {
+        LogDrainer::GetInstance().remove(this);
+    }
+}
+
+void DebugLog::startBackgroundDrain() {
+    if (!_backgroundDrain) {
+        _backgroundDrain = true;
+        LogDrainer::GetInstance().add(this);
+    }
+}
+
+size_t DebugLog::drain() {
+    LogBatch batch;
+    collect(batch);
+    return batch.deliver();
+}
+
+void DebugLog::collect(LogBatch& batch) {
+    std::lock_guard<std::mutex> lock(_drainMutex);
+    char message[k_maxMessage];
+    LogRecord record;
+    while (_records.pop(record)) {
+        Callback callback = _callback.load(std::memory_order_acquire);
+        if (callback == nullptr || record.level > _level.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        formatLogRecord(record, message, sizeof(message));
+        batch.add(callback, message);
+    }
+    uint64_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+    Callback callback = _callback.load(std::memory_order_acquire);
+    if (dropped > 0 && callback != nullptr) {
+        snprintf(message, sizeof(message), "%llu debug log messages dropped, the log ring was full", static_cast<unsigned long long>(dropped));
+        batch.add(callback, message);
+    }
+}
+
+#pragma mark - Log Batch
+
+void LogBatch::add(Callback callback, const char* message) {
+    _messages.push_back(Message{callback, _text.size()});
+    _text.append(message);
+    _text.push_back('\0');
+}
+
+size_t LogBatch::deliver() {
+    size_t delivered = _messages.size();
+    for (const Message& message : _messages) {
+        message.callback(_text.data() + message.offset);
+    }
+    _messages.clear();
+    _text.clear();
+    return delivered;
+}
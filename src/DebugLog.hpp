@@ -0,0 +1,159 @@
+//
+//  DebugLog.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef DebugLog_hpp
+#define DebugLog_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "CommandQueue.hpp"
+
+struct LogLevel {
+    enum {
+        Error,
+        Warning,
+        Info,
+        Debug,
+        Trace
+    };
+};
+
+// Messages above this level are compiled out, arguments included.
+#ifndef SECONDARY_TASK_LOG_LEVEL
+#define SECONDARY_TASK_LOG_LEVEL LogLevel::Trace
+#endif
+
+#define DEBUG_LOG(log, level, ...) \
+    do { \
+        if ((level) <= SECONDARY_TASK_LOG_LEVEL && (log).isEnabled(level)) { \
+            (log).write((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+// One queued message: the printf format (which must be a literal, it doubles as
+// the message id) and its raw arguments, formatted only when the log is drained.
+struct LogRecord {
+    static const size_t k_maxArguments = 6;
+
+    enum ArgumentType : uint8_t {
+        Signed,
+        Unsigned,
+        Floating,
+        String      // must point to static storage
+    };
+
+    const char* format = nullptr;
+    uint8_t level = 0;
+    uint8_t argumentCount = 0;
+    uint8_t types[k_maxArguments];
+    uint64_t arguments[k_maxArguments];
+};
+
+// Formatted messages and the callback each goes to. Collected while a log's lock is held and
+// delivered after it was released, so a callback may do anything, destroying its session included.
+class LogBatch {
+public:
+    typedef void (*Callback)(const char*);
+
+    void add(Callback callback, const char* message);
+    // Calls the callbacks in order and empties the batch. Returns how many were called.
+    size_t deliver();
+
+private:
+    struct Message {
+        Callback callback;
+        size_t offset;      // into _text, NUL terminated
+    };
+
+    std::vector<Message> _messages;
+    std::string _text;
+};
+
+// Per session log. write() only copies the format pointer and the arguments
+// into a lock-free ring, dropping the message if the ring is full, so logging
+// never blocks the thread that measures. Formatting and the host callback
+// happen in drain(), called by the shared background drainer or on demand.
+class DebugLog {
+public:
+    typedef void (*Callback)(const char*);
+
+    DebugLog();
+    ~DebugLog();
+
+    DebugLog(DebugLog const&) = delete;
+    DebugLog& operator=(DebugLog const&) = delete;
+
+    void setCallback(Callback callback) { _callback.store(callback, std::memory_order_release); }
+    void setLevel(int level) { _level.store(level, std::memory_order_relaxed); }
+    int level() const { return _level.load(std::memory_order_relaxed); }
+
+    bool isEnabled(int level) const {
+        return level <= _level.load(std::memory_order_relaxed) && _callback.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    template <typename... Args>
+    void write(int level, const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= LogRecord::k_maxArguments, "too many log arguments");
+        LogRecord record;
+        record.format = format;
+        record.level = static_cast<uint8_t>(level);
+        record.argumentCount = static_cast<uint8_t>(sizeof...(Args));
+        storeArguments(record, 0, args...);
+        if (!_records.tryPush(record)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Formats every queued message and hands it to the callback on the calling
+    // thread. Returns how many were delivered. Safe from any thread.
+    size_t drain();
+    // Formats every queued message into batch, for the caller to deliver.
+    void collect(LogBatch& batch);
+
+    // Hand this log to the process wide drainer thread.
+    void startBackgroundDrain();
+
+private:
+    static void storeArguments(LogRecord&, size_t) {}
+
+    template <typename T, typename... Rest>
+    static void storeArguments(LogRecord& record, size_t index, T value, Rest... rest) {
+        storeArgument(record, index, value);
+        storeArguments(record, index + 1, rest...);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+    storeArgument(LogRecord& record, size_t index, T value) {
+        bool isSigned = std::is_signed<T>::value || std::is_enum<T>::value;
+        record.types[index] = isSigned ? LogRecord::Signed : LogRecord::Unsigned;
+        record.arguments[index] = isSigned ? static_cast<uint64_t>(static_cast<int64_t>(value)) : static_cast<uint64_t>(value);
+    }
+
+    static void storeArgument(LogRecord& record, size_t index, double value) {
+        record.types[index] = LogRecord::Floating;
+        memcpy(&record.arguments[index], &value, sizeof(value));
+    }
+
+    static void storeArgument(LogRecord& record, size_t index, const char* value) {
+        record.types[index] = LogRecord::String;
+        record.arguments[index] = reinterpret_cast<uintptr_t>(value);
+    }
+
+    CommandQueue<LogRecord, 1024> _records;
+    std::mutex _drainMutex;     // one consumer at a time
+    std::atomic<Callback> _callback;
+    std::atomic<int> _level;
+    std::atomic<uint64_t> _dropped;
+    bool _backgroundDrain;
+};
+
+#endif /* DebugLog_hpp */
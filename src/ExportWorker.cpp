@@ -0,0 +1,142 @@
+//
+//  ExportWorker.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "ExportWorker.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+ExportWorker& ExportWorker::GetInstance() {
+    // Leaked like the timer scheduler so the thread is never joined during plugin unload.
+    static ExportWorker* instance = new ExportWorker();
+    return *instance;
+}
+
+ExportWorker::ExportWorker() : _thread(&ExportWorker::run, this) {
+}
+
+uint64_t ExportWorker::reserve(const void* owner) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t request = _nextRequest++;
+    _pending.push_back(Reservation{request, owner});
+    return request;
+}
+
+void ExportWorker::submit(std::unique_ptr<ExportJob> job) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _wakeUp.notify_one();
+}
+
+ExportWorker::Status ExportWorker::take(uint64_t request, const void* owner, char*& data, size_t& size, uint64_t& next) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto result = _results.begin(); result != _results.end(); ++result) {
+        if (result->request == request && result->owner == owner) {
+            data = result->data;
+            size = result->size;
+            next = result->next;
+            _results.erase(result);
+            return Ready;
+        }
+    }
+    for (const Reservation& reservation : _pending) {
+        if (reservation.request == request && reservation.owner == owner) {
+            return Pending;
+        }
+    }
+    return Unknown;
+}
+
+ExportWorker::Status ExportWorker::status(uint64_t request, const void* owner) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const Result& result : _results) {
+        if (result.request == request && result.owner == owner) {
+            return Ready;
+        }
+    }
+    for (const Reservation& reservation : _pending) {
+        if (reservation.request == request && reservation.owner == owner) {
+            return Pending;
+        }
+    }
+    return Unknown;
+}
+
+void ExportWorker::discard(const void* owner) {
+    std::lock_guard<std::recursive_mutex> completionLock(_completionMutex);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.erase(std::remove_if(_jobs.begin(), _jobs.end(), [owner](const std::unique_ptr<ExportJob>& job) {
+        return job->owner == owner;
+    }), _jobs.end());
+    _pending.erase(std::remove_if(_pending.begin(), _pending.end(), [owner](const Reservation& reservation) {
+        return reservation.owner == owner;
+    }), _pending.end());
+    for (const Result& result : _results) {
+        if (result.owner == owner) {
+            free(result.data);
+        }
+    }
+    _results.erase(std::remove_if(_results.begin(), _results.end(), [owner](const Result& result) {
+        return result.owner == owner;
+    }), _results.end());
+    if (_runningOwner == owner) {
+        _runningDiscarded = true;
+    }
+}
+
+// Written in one pass into a buffer sized from the record count, and rewritten only if that was too small.
+char* ExportWorker::serialise(const ExportJob& job, size_t& size) {
+    size_t capacity = job.estimate(job);
+    char* data = (char*)malloc(capacity);
+    JsonWriter writer(data, capacity);
+    job.write(writer, job);
+    if (!writer.terminate()) {
+        capacity = writer.size() + 1;
+        free(data);
+        data = (char*)malloc(capacity);
+        JsonWriter exactWriter(data, capacity);
+        job.write(exactWriter, job);
+        exactWriter.terminate();
+    }
+    size = writer.size();
+    return data;
+}
+
+void ExportWorker::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _wakeUp.wait(lock, [this]{ return !_jobs.empty(); });
+        std::unique_ptr<ExportJob> job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _runningOwner = job->owner;
+        _runningDiscarded = false;
+        lock.unlock();
+
+        size_t size;
+        char* data = serialise(*job, size);
+
+        std::unique_lock<std::recursive_mutex> completionLock(_completionMutex);
+        lock.lock();
+        bool discarded = _runningDiscarded;
+        _runningOwner = nullptr;
+        if (discarded) {
+            free(data);
+        } else {
+            _pending.erase(std::remove_if(_pending.begin(), _pending.end(), [&job](const Reservation& reservation) {
+                return reservation.request == job->request;
+            }), _pending.end());
+            _results.push_back(Result{job->request, job->owner, data, size, job->next});
+        }
+        lock.unlock();
+        if (!discarded && job->completion != nullptr) {
+            job->completion(job->request, job->context);
+        }
+        completionLock.unlock();
+        job.reset();    // releases the snapshot's chunks off the lock
+        lock.lock();
+    }
+}
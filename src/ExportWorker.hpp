@@ -0,0 +1,95 @@
+//
+//  ExportWorker.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef ExportWorker_hpp
+#define ExportWorker_hpp
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "JsonExport.hpp"
+#include "SessionStore.hpp"
+
+// One export to serialise in the background. The snapshot keeps the records alive,
+// so a job never touches the session it came from.
+struct ExportJob {
+    uint64_t request = 0;
+    const void* owner = nullptr;        // the session, see ExportWorker::discard
+    SessionStore::Snapshot snapshot;
+    JsonExportOptions options;
+    int kind = 0;
+    uint64_t next = 0;                  // the cursor to export since, then the one after this export
+    size_t (*estimate)(const ExportJob& job) = nullptr;
+    void (*write)(JsonWriter& writer, const ExportJob& job) = nullptr;
+    void (*completion)(unsigned long long request, void* context) = nullptr;    // as the C API declares it
+    void* context = nullptr;
+};
+
+// Single background thread that serialises the exports of every session, so the
+// host's thread only pays for handing over a snapshot. Finished exports wait
+// here until their owner takes them.
+class ExportWorker {
+public:
+    static ExportWorker& GetInstance();
+
+    ExportWorker(ExportWorker const&) = delete;
+    ExportWorker& operator=(ExportWorker const&) = delete;
+
+    // New request id, pending until its job has run (or was discarded). Never 0.
+    uint64_t reserve(const void* owner);
+    void submit(std::unique_ptr<ExportJob> job);
+
+    enum Status {
+        Pending,
+        Ready,
+        Unknown
+    };
+    // Ready hands the malloc'ed, NUL terminated export (size without the terminator) to the caller.
+    Status take(uint64_t request, const void* owner, char*& data, size_t& size, uint64_t& next);
+    // Like take, but leaves a finished export queued.
+    Status status(uint64_t request, const void* owner);
+
+    // Forgets every request of owner. Returns once no completion of owner runs or will run.
+    void discard(const void* owner);
+
+private:
+    ExportWorker();
+    ~ExportWorker() {}
+
+    struct Reservation {
+        uint64_t request;
+        const void* owner;
+    };
+
+    struct Result {
+        uint64_t request;
+        const void* owner;
+        char* data;
+        size_t size;
+        uint64_t next;
+    };
+
+    void run();
+    static char* serialise(const ExportJob& job, size_t& size);
+
+    std::mutex _mutex;                      // guards everything below
+    std::recursive_mutex _completionMutex;  // held while a completion runs, taken before _mutex
+    std::condition_variable _wakeUp;
+    std::deque<std::unique_ptr<ExportJob>> _jobs;
+    std::vector<Reservation> _pending;      // reserved, not finished yet
+    std::vector<Result> _results;
+    uint64_t _nextRequest = 1;
+    const void* _runningOwner = nullptr;
+    bool _runningDiscarded = false;
+    std::thread _thread;
+};
+
+#endif /* ExportWorker_hpp */
@@ -0,0 +1,177 @@
+//
+//  JsonExport.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "JsonExport.hpp"
+
+#include <string>
+#include <vector>
+
+static int64_t exportedTime(const JsonExportOptions& options, int64_t microseconds) {
+    return options.highResolution ? microseconds : microseconds / 1000;
+}
+
+// Opens a milestone group when the record is the first or starts a new one, otherwise separates it from the previous record.
+static void beginRecord(JsonWriter& writer, uint32_t milestone, bool& first, uint32_t& previousMilestone) {
+    if (!first && milestone == previousMilestone) {
+        writer.put(',');
+        return;
+    }
+    if (!first) {
+        writer.raw("],", 2);
+    }
+    writer.put('[');
+    writer.integer(milestone);
+    writer.put(',');
+    first = false;
+    previousMilestone = milestone;
+}
+
+// Every position quoted and escaped once, rather than once per reaction.
+class QuotedPositions {
+public:
+    explicit QuotedPositions(const SessionStore::Snapshot& snapshot) {
+        const SessionStore::StringLog::Snapshot& positions = snapshot.positions;
+        _ends.reserve(positions.size());
+        for (size_t id = positions.begin(); id < positions.end(); id++) {
+            const char* position = snapshot.position(static_cast<uint32_t>(id));
+            JsonWriter measure(nullptr, 0);
+            measure.string(position);
+            size_t start = _text.size();
+            _text.resize(start + measure.size());
+            JsonWriter writer(&_text[start], measure.size());
+            writer.string(position);
+            _ends.push_back(_text.size());
+        }
+    }
+
+    void write(JsonWriter& writer, uint32_t id) const {
+        size_t start = id == 0 ? 0 : _ends[id - 1];
+        writer.raw(_text.data() + start, _ends[id] - start);
+    }
+
+private:
+    std::string _text;
+    std::vector<size_t> _ends;
+};
+
+void writeReactionsJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot, const JsonExportOptions& options) {
+    const SessionStore::ReactionLog::Snapshot& reactions = snapshot.reactions;
+    QuotedPositions quotedPositions(snapshot);
+    bool first = true;
+    uint32_t previousMilestone = 0;
+    writer.put('[');
+
+    reactions.forEachChunk([&](const ReactionChunk& chunk, size_t firstSlot, size_t endSlot) {
+        for (size_t slot = firstSlot; slot < endSlot; slot++) {
+            beginRecord(writer, chunk.milestone[slot], first, previousMilestone);
+            writer.put('[');
+            writer.integer(exportedTime(options, chunk.sinceStart[slot]));
+            writer.put(',');
+            writer.integer(exportedTime(options, chunk.reactionTime[slot]));
+            if (options.highResolution) {
+                writer.put(',');
+                writer.integer(chunk.callbackDuration[slot]);
+            }
+            writer.put(',');
+            if (options.positionIds) {
+                writer.integer(chunk.position[slot]);
+            } else {
+                quotedPositions.write(writer, chunk.position[slot]);
+            }
+            if (options.channels) {
+                writer.put(',');
+                writer.integer(chunk.channel[slot]);
+            }
+            writer.put(',');
+            writer.integer(chunk.outcome[slot]);
+            writer.put(']');
+        }
+    });
+    if (!reactions.empty()) {
+        writer.put(']');
+    }
+
+    writer.put(']');
+}
+
+void writeEventsJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot, const JsonExportOptions& options) {
+    const SessionStore::EventLog::Snapshot& events = snapshot.events;
+    bool first = true;
+    uint32_t previousMilestone = 0;
+    writer.put('[');
+
+    events.forEachChunk([&](const EventChunk& chunk, size_t firstSlot, size_t endSlot) {
+        for (size_t slot = firstSlot; slot < endSlot; slot++) {
+            beginRecord(writer, chunk.milestone[slot], first, previousMilestone);
+            writer.put('[');
+            writer.integer(exportedTime(options, chunk.sinceStart[slot]));
+            writer.put(',');
+            writer.string(snapshot.eventName(chunk.name[slot]));
+            writer.put(']');
+        }
+    });
+    if (!events.empty()) {
+        writer.put(']');
+    }
+
+    writer.put(']');
+}
+
+void writeTelemetryJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot, const JsonExportOptions& options) {
+    const SessionStore::TelemetryLog::Snapshot& telemetry = snapshot.telemetry;
+    bool first = true;
+    uint32_t previousMilestone = 0;
+    writer.put('[');
+
+    telemetry.forEachChunk([&](const TelemetryChunk& chunk, size_t firstSlot, size_t endSlot) {
+        for (size_t slot = firstSlot; slot < endSlot; slot++) {
+            beginRecord(writer, chunk.milestone[slot], first, previousMilestone);
+            writer.put('[');
+            writer.integer(exportedTime(options, chunk.sinceStart[slot]));
+            writer.put(',');
+            writer.integer(chunk.id[slot]);
+            for (uint32_t field = 0; field < chunk.fieldCount[slot]; field++) {
+                writer.put(',');
+                writer.number(chunk.fields[field][slot]);
+            }
+            writer.put(']');
+        }
+    });
+    if (!telemetry.empty()) {
+        writer.put(']');
+    }
+
+    writer.put(']');
+}
+
+void writePositionDictionaryJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot) {
+    const SessionStore::StringLog::Snapshot& positions = snapshot.positions;
+    writer.put('[');
+
+    for (size_t id = positions.begin(); id < positions.end(); id++) {
+        if (id != positions.begin()) {
+            writer.put(',');
+        }
+        writer.string(snapshot.position(static_cast<uint32_t>(id)));
+    }
+
+    writer.put(']');
+}
+
+size_t estimateReactionsJson(const SessionStore::Snapshot& snapshot) {
+    return 64 + snapshot.reactions.size() * 48;
+}
+
+size_t estimateEventsJson(const SessionStore::Snapshot& snapshot) {
+    return 64 + snapshot.events.size() * 48;
+}
+
+size_t estimateTelemetryJson(const SessionStore::Snapshot& snapshot) {
+    return 64 + snapshot.telemetry.size() * 96;
+}
+
+size_t estimatePositionDictionaryJson(const SessionStore::Snapshot& snapshot) {
+    return 64 + snapshot.positions.size() * 24;
+}
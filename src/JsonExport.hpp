@@ -0,0 +1,38 @@
+//
+//  JsonExport.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef JsonExport_hpp
+#define JsonExport_hpp
+
+#include "JsonWriter.hpp"
+#include "SessionStore.hpp"
+
+// JSON serialisers for a store snapshot. Records are grouped by milestone:
+//   reactions  [[milestone,[time,reaction,"position",outcome],...],...]
+//   events     [[milestone,[time,"name"],...],...]
+//   telemetry  [[milestone,[time,id,field,...],...],...]   (grouped like events)
+//   positions  ["",...]   (indexed by position id)
+// Times are whole milliseconds, or microseconds in high resolution mode, which also
+// adds the stimulus callback duration in microseconds before the position. Sessions
+// with several stimulus channels add each reaction's channel after the position. The
+// ReactionOutcome (0 response, 1 timeout, 2 false start) always comes last.
+struct JsonExportOptions {
+    bool highResolution = false;
+    bool positionIds = false;   // write the interned id instead of the position string
+    bool channels = false;      // write the reaction's stimulus channel
+};
+
+void writeReactionsJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot, const JsonExportOptions& options);
+void writeEventsJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot, const JsonExportOptions& options);
+void writeTelemetryJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot, const JsonExportOptions& options);
+void writePositionDictionaryJson(JsonWriter& writer, const SessionStore::Snapshot& snapshot);
+
+// Generous guess of the output size, to size a buffer in one go.
+size_t estimateReactionsJson(const SessionStore::Snapshot& snapshot);
+size_t estimateEventsJson(const SessionStore::Snapshot& snapshot);
+size_t estimateTelemetryJson(const SessionStore::Snapshot& snapshot);
+size_t estimatePositionDictionaryJson(const SessionStore::Snapshot& snapshot);
+
+#endif /* JsonExport_hpp */
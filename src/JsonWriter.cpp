@@ -0,0 +1,123 @@
+//
+//  JsonWriter.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "JsonWriter.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const char k_digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char k_hexDigits[] = "0123456789abcdef";
+
+void JsonWriter::raw(const char* text, size_t length) {
+    if (_size < _capacity) {
+        size_t room = _capacity - _size;
+        memcpy(_buffer + _size, text, length < room ? length : room);
+    }
+    _size += length;
+}
+
+void JsonWriter::integer(int64_t value) {
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* first = end;
+    // negate in unsigned arithmetic so INT64_MIN survives
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+
+    while (magnitude >= 100) {
+        const char* pair = k_digitPairs + (magnitude % 100) * 2;
+        magnitude /= 100;
+        *--first = pair[1];
+        *--first = pair[0];
+    }
+    if (magnitude >= 10) {
+        const char* pair = k_digitPairs + magnitude * 2;
+        *--first = pair[1];
+        *--first = pair[0];
+    } else {
+        *--first = static_cast<char>('0' + magnitude);
+    }
+
+    if (value < 0) {
+        put('-');
+    }
+    raw(first, end - first);
+}
+
+void JsonWriter::number(float value) {
+    if (!std::isfinite(value)) {
+        raw("null", 4);
+        return;
+    }
+    if (value == std::floor(value) && std::fabs(value) < 1e15f) {
+        integer(static_cast<int64_t>(value));
+        return;
+    }
+    char digits[32];
+    int length = 0;
+    for (int precision = 6; precision <= 9; precision++) {
+        length = snprintf(digits, sizeof(digits), "%.*g", precision, value);
+        if (strtof(digits, nullptr) == value) {
+            break;
+        }
+    }
+    for (int i = 0; i < length; i++) {
+        if (digits[i] == ',') {
+            digits[i] = '.';    // decimal comma of the host's locale
+        }
+    }
+    raw(digits, static_cast<size_t>(length));
+}
+
+void JsonWriter::string(const char* text) {
+    put('"');
+    const char* run = text;
+    for (const char* p = text; *p != '\0'; p++) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        raw(run, p - run);
+        run = p + 1;
+        put('\\');
+        switch (c) {
+            case '"': put('"'); break;
+            case '\\': put('\\'); break;
+            case '\b': put('b'); break;
+            case '\f': put('f'); break;
+            case '\n': put('n'); break;
+            case '\r': put('r'); break;
+            case '\t': put('t'); break;
+            default:
+                raw("u00", 3);
+                put(k_hexDigits[c >> 4]);
+                put(k_hexDigits[c & 0xf]);
+                break;
+        }
+    }
+    raw(run, strlen(run));
+    put('"');
+}
+
+bool JsonWriter::terminate() {
+    if (_size < _capacity) {
+        _buffer[_size] = '\0';
+        return true;
+    }
+    return false;
+}
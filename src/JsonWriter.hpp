@@ -0,0 +1,50 @@
+//
+//  JsonWriter.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef JsonWriter_hpp
+#define JsonWriter_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+// Writes JSON text into a fixed buffer without allocating. Output past the
+// capacity is dropped but still counted, so running a serialiser against an
+// empty writer measures it and running it again against a buffer of size()
+// bytes fills it.
+class JsonWriter {
+public:
+    JsonWriter(char* buffer, size_t capacity) : _buffer(buffer), _capacity(capacity), _size(0) {}
+
+    JsonWriter(JsonWriter const&) = delete;
+    JsonWriter& operator=(JsonWriter const&) = delete;
+
+    // Bytes the output needs, not counting the terminator.
+    size_t size() const { return _size; }
+    bool overflowed() const { return _size > _capacity; }
+
+    void put(char c) {
+        if (_size < _capacity) {
+            _buffer[_size] = c;
+        }
+        _size++;
+    }
+
+    void raw(const char* text, size_t length);
+    void integer(int64_t value);
+    // Shortest form that reads back as the same float; null when not finite.
+    void number(float value);
+    // Quoted and escaped; bytes >= 0x80 pass through, so UTF-8 input stays UTF-8.
+    void string(const char* text);
+
+    // Adds the NUL after the output when it fits.
+    bool terminate();
+
+private:
+    char* _buffer;
+    size_t _capacity;
+    size_t _size;
+};
+
+#endif /* JsonWriter_hpp */
@@ -0,0 +1,121 @@
+//
+//  ReactionStats.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "ReactionStats.hpp"
+
+#include <algorithm>
+
+#pragma mark - P2 Quantile
+
+P2Quantile::P2Quantile(double quantile) :
+    _quantile(quantile),
+    _count(0)
+{
+    for (int i = 0; i < 5; i++) {
+        _heights[i] = 0;
+        _positions[i] = i + 1;
+    }
+    _desired[0] = 1;
+    _desired[1] = 1 + 2 * quantile;
+    _desired[2] = 1 + 4 * quantile;
+    _desired[3] = 3 + 2 * quantile;
+    _desired[4] = 5;
+    _increments[0] = 0;
+    _increments[1] = quantile / 2;
+    _increments[2] = quantile;
+    _increments[3] = (1 + quantile) / 2;
+    _increments[4] = 1;
+}
+
+void P2Quantile::add(double value) {
+    if (_count < 5) {
+        _heights[_count++] = value;
+        std::sort(_heights, _heights + _count);
+        return;
+    }
+    _count++;
+
+    // cell the value falls in, stretching the extreme markers if needed
+    int cell;
+    if (value < _heights[0]) {
+        _heights[0] = value;
+        cell = 0;
+    } else if (value >= _heights[4]) {
+        _heights[4] = std::max(_heights[4], value);
+        cell = 3;
+    } else {
+        cell = 0;
+        while (value >= _heights[cell + 1]) {
+            cell++;
+        }
+    }
+    for (int i = cell + 1; i < 5; i++) {
+        _positions[i]++;
+    }
+    for (int i = 0; i < 5; i++) {
+        _desired[i] += _increments[i];
+    }
+
+    // move the middle markers towards their desired positions
+    for (int i = 1; i < 4; i++) {
+        double offset = _desired[i] - _positions[i];
+        if ((offset >= 1 && _positions[i + 1] - _positions[i] > 1) ||
+            (offset <= -1 && _positions[i - 1] - _positions[i] < -1)) {
+            int direction = offset > 0 ? 1 : -1;
+            double height = parabolic(i, direction);
+            if (_heights[i - 1] < height && height < _heights[i + 1]) {
+                _heights[i] = height;
+            } else {
+                _heights[i] = linear(i, direction);
+            }
+            _positions[i] += direction;
+        }
+    }
+}
+
+double P2Quantile::value() const {
+    if (_count == 0) {
+        return 0;
+    }
+    if (_count <= 5) {
+        // interpolated between the sorted samples
+        double rank = _quantile * (_count - 1);
+        uint32_t below = static_cast<uint32_t>(rank);
+        uint32_t above = std::min(below + 1, _count - 1);
+        return _heights[below] + (rank - below) * (_heights[above] - _heights[below]);
+    }
+    return _heights[2];
+}
+
+double P2Quantile::parabolic(int i, double direction) const {
+    double below = _positions[i] - _positions[i - 1];
+    double above = _positions[i + 1] - _positions[i];
+    double span = _positions[i + 1] - _positions[i - 1];
+    return _heights[i] + direction / span *
+        ((below + direction) * (_heights[i + 1] - _heights[i]) / above +
+         (above - direction) * (_heights[i] - _heights[i - 1]) / below);
+}
+
+double P2Quantile::linear(int i, int direction) const {
+    return _heights[i] + direction * (_heights[i + direction] - _heights[i]) / (_positions[i + direction] - _positions[i]);
+}
+
+#pragma mark - Reaction Stats
+
+void ReactionStats::addResponse(double reactionTime) {
+    responses++;
+    double delta = reactionTime - mean;
+    mean += delta / responses;
+    m2 += delta * (reactionTime - mean);
+    if (responses == 1) {
+        minimum = reactionTime;
+        maximum = reactionTime;
+    } else {
+        minimum = std::min(minimum, reactionTime);
+        maximum = std::max(maximum, reactionTime);
+    }
+    median.add(reactionTime);
+    p90.add(reactionTime);
+}
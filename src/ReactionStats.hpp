@@ -0,0 +1,51 @@
+//
+//  ReactionStats.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef ReactionStats_hpp
+#define ReactionStats_hpp
+
+#include <cstdint>
+
+// Streaming estimate of one quantile with the P² algorithm (Jain & Chlamtac):
+// five markers whose heights follow the quantile, constant space and time per sample.
+// Exact while five or fewer samples have been seen.
+class P2Quantile {
+public:
+    explicit P2Quantile(double quantile);
+
+    void add(double value);
+    double value() const;
+
+private:
+    double parabolic(int i, double direction) const;
+    double linear(int i, int direction) const;
+
+    double _quantile;
+    uint32_t _count;
+    double _heights[5];
+    double _positions[5];
+    double _desired[5];
+    double _increments[5];
+};
+
+// Running figures of one milestone group, updated as each response is processed.
+// Times are in microseconds, like the stored reaction times.
+struct ReactionStats {
+    uint32_t responses = 0;     // the figures below are computed from these only
+    uint32_t timeouts = 0;
+    uint32_t falseStarts = 0;   // faster than humanly possible, stored as timeouts
+    double mean = 0;
+    double m2 = 0;              // sum of squared deviations from the mean (Welford)
+    double minimum = 0;
+    double maximum = 0;
+    P2Quantile median = P2Quantile(0.5);
+    P2Quantile p90 = P2Quantile(0.9);
+
+    void addResponse(double reactionTime);
+    // Sample variance, 0 below two responses.
+    double variance() const { return responses > 1 ? m2 / (responses - 1) : 0; }
+};
+
+#endif /* ReactionStats_hpp */
@@ -0,0 +1,71 @@
+//
+//  Semaphore.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "Semaphore.hpp"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <climits>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <cerrno>
+#endif
+
+#if defined(_WIN32)
+
+Semaphore::Semaphore() : _handle(CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr)) {}
+
+Semaphore::~Semaphore() {
+    CloseHandle(_handle);
+}
+
+void Semaphore::post() {
+    ReleaseSemaphore(_handle, 1, nullptr);
+}
+
+void Semaphore::wait() {
+    WaitForSingleObject(_handle, INFINITE);
+}
+
+#elif defined(__APPLE__)
+
+Semaphore::Semaphore() : _handle(dispatch_semaphore_create(0)) {}
+
+Semaphore::~Semaphore() {
+    dispatch_release(static_cast<dispatch_semaphore_t>(_handle));
+}
+
+void Semaphore::post() {
+    dispatch_semaphore_signal(static_cast<dispatch_semaphore_t>(_handle));
+}
+
+void Semaphore::wait() {
+    dispatch_semaphore_wait(static_cast<dispatch_semaphore_t>(_handle), DISPATCH_TIME_FOREVER);
+}
+
+#else
+
+Semaphore::Semaphore() {
+    sem_init(&_semaphore, 0, 0);
+}
+
+Semaphore::~Semaphore() {
+    sem_destroy(&_semaphore);
+}
+
+void Semaphore::post() {
+    sem_post(&_semaphore);
+}
+
+void Semaphore::wait() {
+    while (sem_wait(&_semaphore) != 0 && errno == EINTR) {
+    }
+}
+
+#endif
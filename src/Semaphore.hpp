@@ -0,0 +1,34 @@
+//
+//  Semaphore.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef Semaphore_hpp
+#define Semaphore_hpp
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+#include <semaphore.h>
+#endif
+
+// Counting semaphore on the platform's own primitive. Unlike a condition variable, post
+// takes no lock: it costs one atomic when nobody waits and one kernel call to wake a waiter.
+class Semaphore {
+public:
+    Semaphore();
+    ~Semaphore();
+
+    Semaphore(Semaphore const&) = delete;
+    Semaphore& operator=(Semaphore const&) = delete;
+
+    void post();
+    void wait();
+
+private:
+#if defined(_WIN32) || defined(__APPLE__)
+    void* _handle;  // HANDLE, dispatch_semaphore_t
+#else
+    sem_t _semaphore;
+#endif
+};
+
+#endif /* Semaphore_hpp */
@@ -0,0 +1,364 @@
+//
+//  SessionJournal.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "SessionJournal.hpp"
+
+#include "BinaryFormat.hpp"
+#include "SessionStore.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using BinaryFormat::loadU16;
+using BinaryFormat::loadU32;
+using BinaryFormat::loadU64;
+using BinaryFormat::storeU16;
+using BinaryFormat::storeU32;
+using BinaryFormat::storeU64;
+
+// Record layout, all little-endian:
+//    0  u32  checksum of bytes 4..63
+//    4  u32  sequence number, 0 for the header record
+//    8  u16  type
+//   10  u16  text length (whole string; Text records: bytes in this record)
+//   12  u32  milestone                       Text records: 52 bytes of text from here
+//   16  u32  position id
+//   20  u32  stimulus channel of Reaction records, 0 otherwise
+//   24  i64  time since the measurement started
+//   32  i64  reaction time
+//   40  i64  callback duration
+//   48  16 bytes of text, the rest follows in Text records
+//       Reaction records have no text and keep the ReactionOutcome in a u8 here instead
+// Telemetry records keep the event id at 16, the field count at 20 and up to
+// eight f32 fields from 32 instead.
+enum RecordType : uint16_t {
+    Header = 1,
+    Clear,
+    Position,
+    Reaction,
+    Event,
+    Text,
+    Telemetry
+};
+
+static const char k_journalMagic[8] = {'S', 'T', 'Y', 'J', 'R', 'N', 'L', '1'};
+static const size_t k_inlineText = 16;
+static const size_t k_continuationText = 52;
+static const size_t k_flushThreshold = 64 * 1024;
+
+static uint32_t checksum(const unsigned char* record) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 4; i < SessionJournal::k_recordSize; i++) {
+        hash = (hash ^ record[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool syncFile(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#if defined(_WIN32)
+    return _commit(_fileno(file)) == 0;
+#elif defined(__APPLE__)
+    return fcntl(fileno(file), F_FULLFSYNC) != -1; // plain fsync leaves the data in the drive's cache on macOS
+#else
+    return fdatasync(fileno(file)) == 0;
+#endif
+}
+
+#pragma mark - Writing
+
+SessionJournal::SessionJournal(const char* path, uint32_t flushIntervalMilliseconds) :
+    _file(fopen(path, "wb")),
+    _flushIntervalMilliseconds(flushIntervalMilliseconds),
+    _sequence(0),
+    _stopping(false),
+    _failed(false)
+{
+    if (_file == nullptr) {
+        return;
+    }
+    _pending.reserve(k_flushThreshold * 2);
+    _writing.reserve(k_flushThreshold * 2);
+
+    unsigned char record[k_recordSize] = {};
+    storeU16(record + 8, Header);
+    memcpy(record + 12, k_journalMagic, sizeof(k_journalMagic));
+    appendRecord(record);
+
+    if (_flushIntervalMilliseconds > 0) {
+        _flusher = std::thread(&SessionJournal::runFlusher, this);
+    }
+}
+
+SessionJournal::~SessionJournal() {
+    if (_file == nullptr) {
+        return;
+    }
+    if (_flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wakeUp.notify_one();
+        _flusher.join();
+    }
+    writeOut();
+    fclose(_file);
+}
+
+void SessionJournal::appendClear() {
+    append(Clear, 0, 0, 0, 0, 0, 0, nullptr);
+}
+
+void SessionJournal::appendPosition(uint32_t id, const char* text) {
+    append(Position, 0, id, 0, 0, 0, 0, text);
+}
+
+void SessionJournal::appendReaction(int64_t sinceStart, int64_t reactionTime, int64_t callbackDuration, uint32_t milestone, uint32_t position, uint32_t channel,
+                                    uint32_t outcome) {
+    if (_file == nullptr) {
+        return;
+    }
+    unsigned char record[k_recordSize] = {};
+    storeU16(record + 8, Reaction);
+    storeU32(record + 12, milestone);
+    storeU32(record + 16, position);
+    storeU32(record + 20, channel);
+    storeU64(record + 24, static_cast<uint64_t>(sinceStart));
+    storeU64(record + 32, static_cast<uint64_t>(reactionTime));
+    storeU64(record + 40, static_cast<uint64_t>(callbackDuration));
+    record[48] = static_cast<unsigned char>(outcome);
+    appendRecord(record);
+}
+
+void SessionJournal::appendEvent(int64_t sinceStart, uint32_t milestone, const char* name) {
+    append(Event, milestone, 0, 0, sinceStart, 0, 0, name);
+}
+
+void SessionJournal::appendTelemetry(int64_t sinceStart, uint32_t milestone, uint32_t id, const float* fields, uint32_t fieldCount) {
+    if (_file == nullptr) {
+        return;
+    }
+    unsigned char record[k_recordSize] = {};
+    storeU16(record + 8, Telemetry);
+    storeU32(record + 12, milestone);
+    storeU32(record + 16, id);
+    storeU32(record + 20, fieldCount);
+    storeU64(record + 24, static_cast<uint64_t>(sinceStart));
+    for (uint32_t field = 0; field < fieldCount; field++) {
+        uint32_t bits;
+        memcpy(&bits, &fields[field], sizeof(bits));
+        storeU32(record + 32 + field * 4, bits);
+    }
+    appendRecord(record);
+}
+
+void SessionJournal::append(uint16_t type, uint32_t milestone, uint32_t value, uint32_t extra, int64_t sinceStart, int64_t reactionTime, int64_t callbackDuration, const char* text) {
+    if (_file == nullptr) {
+        return;
+    }
+    size_t length = text != nullptr ? strlen(text) : 0;
+    if (length > UINT16_MAX) {
+        length = UINT16_MAX;
+    }
+
+    unsigned char record[k_recordSize] = {};
+    storeU16(record + 8, type);
+    storeU16(record + 10, static_cast<uint16_t>(length));
+    storeU32(record + 12, milestone);
+    storeU32(record + 16, value);
+    storeU32(record + 20, extra);
+    storeU64(record + 24, static_cast<uint64_t>(sinceStart));
+    storeU64(record + 32, static_cast<uint64_t>(reactionTime));
+    storeU64(record + 40, static_cast<uint64_t>(callbackDuration));
+    size_t copied = length < k_inlineText ? length : k_inlineText;
+    if (copied > 0) {
+        memcpy(record + 48, text, copied);
+    }
+    appendRecord(record);
+
+    while (copied < length) {
+        unsigned char continuation[k_recordSize] = {};
+        size_t chunk = length - copied < k_continuationText ? length - copied : k_continuationText;
+        storeU16(continuation + 8, Text);
+        storeU16(continuation + 10, static_cast<uint16_t>(chunk));
+        memcpy(continuation + 12, text + copied, chunk);
+        appendRecord(continuation);
+        copied += chunk;
+    }
+}
+
+void SessionJournal::appendRecord(unsigned char* record) {
+    storeU32(record + 4, _sequence++);
+    storeU32(record, checksum(record));
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.insert(_pending.end(), record, record + k_recordSize);
+        full = _pending.size() >= k_flushThreshold;
+    }
+    if (_flushIntervalMilliseconds == 0) {
+        writeOut();
+    } else if (full) {
+        _wakeUp.notify_one();
+    }
+}
+
+void SessionJournal::flush() {
+    if (_file != nullptr) {
+        writeOut();
+    }
+}
+
+void SessionJournal::runFlusher() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopping) {
+        _wakeUp.wait_for(lock, std::chrono::milliseconds(_flushIntervalMilliseconds), [this]{
+            return _stopping || _pending.size() >= k_flushThreshold;
+        });
+        if (_pending.empty()) {
+            continue;
+        }
+        lock.unlock();
+        writeOut();
+        lock.lock();
+    }
+}
+
+void SessionJournal::writeOut() {
+    std::lock_guard<std::mutex> fileLock(_fileMutex);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _writing.swap(_pending);
+    }
+    if (_writing.empty()) {
+        return;
+    }
+    if (!_failed.load(std::memory_order_relaxed)
+        && (fwrite(_writing.data(), 1, _writing.size(), _file) != _writing.size() || !syncFile(_file))) {
+        _failed.store(true, std::memory_order_relaxed);
+    }
+    _writing.clear();
+}
+
+#pragma mark - Recovery
+
+// Reads the next record that checks out and carries the expected sequence number.
+static bool readRecord(FILE* file, unsigned char* record, uint32_t sequence) {
+    return fread(record, 1, SessionJournal::k_recordSize, file) == SessionJournal::k_recordSize &&
+           loadU32(record) == checksum(record) && loadU32(record + 4) == sequence;
+}
+
+bool SessionJournal::recover(const char* path, SessionStore& store) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    unsigned char record[k_recordSize];
+    uint32_t sequence = 0;
+    if (!readRecord(file, record, sequence++) || loadU16(record + 8) != Header ||
+        memcmp(record + 12, k_journalMagic, sizeof(k_journalMagic)) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    // A clear only takes effect once the new measurement records something, so
+    // stopping (or restarting) after the last response doesn't lose the run.
+    store.clear();
+    std::vector<uint32_t> positions;    // journal position id -> store position id
+    bool clearPending = false;
+    std::vector<std::pair<uint32_t, std::string>> pendingPositions;
+    auto addPosition = [&](uint32_t id, const char* text) {
+        if (positions.size() <= id) {
+            positions.resize(id + 1, SessionStore::k_noPosition);
+        }
+        positions[id] = store.internPosition(text);
+    };
+    auto applyPendingClear = [&]() {
+        if (!clearPending) {
+            return;
+        }
+        store.clear();
+        positions.clear();
+        for (const auto& position : pendingPositions) {
+            addPosition(position.first, position.second.c_str());
+        }
+        pendingPositions.clear();
+        clearPending = false;
+    };
+
+    std::string text;
+    while (readRecord(file, record, sequence++)) {
+        uint16_t type = loadU16(record + 8);
+        size_t length = loadU16(record + 10);
+        text.assign(reinterpret_cast<const char*>(record + 48), length < k_inlineText ? length : k_inlineText);
+        bool complete = true;
+        while (complete && text.size() < length) {
+            unsigned char continuation[k_recordSize];
+            complete = readRecord(file, continuation, sequence++) && loadU16(continuation + 8) == Text;
+            if (complete) {
+                text.append(reinterpret_cast<const char*>(continuation + 12), loadU16(continuation + 10));
+            }
+        }
+        if (!complete) {
+            break;
+        }
+
+        uint32_t milestone = loadU32(record + 12);
+        uint32_t value = loadU32(record + 16);
+        int64_t sinceStart = static_cast<int64_t>(loadU64(record + 24));
+        switch (type) {
+            case Clear:
+                clearPending = true;
+                pendingPositions.clear();
+                break;
+            case Position:
+                if (clearPending) {
+                    pendingPositions.emplace_back(value, text);
+                } else {
+                    addPosition(value, text.c_str());
+                }
+                break;
+            case Reaction:
+                applyPendingClear();
+                store.appendReaction(sinceStart, static_cast<int64_t>(loadU64(record + 32)), static_cast<int64_t>(loadU64(record + 40)),
+                                     milestone, value < positions.size() ? positions[value] : SessionStore::k_noPosition, loadU32(record + 20),
+                                     record[48] < ReactionOutcome::Count ? record[48] : static_cast<uint32_t>(ReactionOutcome::Response));
+                break;
+            case Event:
+                applyPendingClear();
+                store.appendEvent(sinceStart, milestone, text.c_str());
+                break;
+            case Telemetry: {
+                TelemetrySample sample;
+                sample.id = value;
+                sample.fieldCount = std::min(loadU32(record + 20), TelemetrySample::k_maxFields);
+                for (uint32_t field = 0; field < sample.fieldCount; field++) {
+                    uint32_t bits = loadU32(record + 32 + field * 4);
+                    memcpy(&sample.fields[field], &bits, sizeof(bits));
+                }
+                applyPendingClear();
+                store.appendTelemetry(sinceStart, milestone, &sample, 1);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,80 @@
+//
+//  SessionJournal.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef SessionJournal_hpp
+#define SessionJournal_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class SessionStore;
+
+// Append-only on-disk copy of everything a SessionStore records, so a session
+// survives the host crashing. Every write becomes one or more fixed size
+// records in a memory buffer; a flusher thread writes the buffer out and syncs
+// it to disk every flush interval (or sooner when it fills up), so appending
+// costs a copy and an uncontended lock rather than a syscall. With an interval
+// of 0 every record is written and synced before append returns.
+// A write or sync that fails (disk full, I/O error) latches hasFailed; the file then keeps
+// what reached it before, and what is appended from then on is dropped.
+//
+// Records are 64 bytes, little-endian, each with a checksum and a running
+// sequence number. Recovery replays them in order and stops at the first one
+// that doesn't check out, which is where a crash tore the tail of the file.
+class SessionJournal {
+public:
+    static const size_t k_recordSize = 64;
+
+    SessionJournal(const char* path, uint32_t flushIntervalMilliseconds);
+    ~SessionJournal();
+
+    SessionJournal(SessionJournal const&) = delete;
+    SessionJournal& operator=(SessionJournal const&) = delete;
+
+    bool isOpen() const { return _file != nullptr; }
+    // Any thread.
+    bool hasFailed() const { return _failed.load(std::memory_order_relaxed); }
+
+    // Called by the store's writer, mirroring its own writes.
+    void appendClear();
+    void appendPosition(uint32_t id, const char* text);
+    void appendReaction(int64_t sinceStart, int64_t reactionTime, int64_t callbackDuration, uint32_t milestone, uint32_t position, uint32_t channel,
+                        uint32_t outcome);
+    void appendEvent(int64_t sinceStart, uint32_t milestone, const char* name);
+    void appendTelemetry(int64_t sinceStart, uint32_t milestone, uint32_t id, const float* fields, uint32_t fieldCount);
+
+    // Writes and syncs everything appended so far.
+    void flush();
+
+    // Rebuilds store from the journal at path, keeping the last measurement that recorded
+    // anything. Returns false if the file can't be read or isn't a journal.
+    static bool recover(const char* path, SessionStore& store);
+
+private:
+    void append(uint16_t type, uint32_t milestone, uint32_t value, uint32_t extra, int64_t sinceStart, int64_t reactionTime, int64_t callbackDuration, const char* text);
+    void appendRecord(unsigned char* record);
+    void runFlusher();
+    void writeOut();
+
+    FILE* _file;
+    uint32_t _flushIntervalMilliseconds;
+    uint32_t _sequence;             // writer only
+
+    std::mutex _fileMutex;          // taken before _mutex; serialises writeOut and guards _writing
+    std::mutex _mutex;              // guards _pending and _stopping
+    std::condition_variable _wakeUp;
+    std::vector<unsigned char> _pending;
+    std::vector<unsigned char> _writing;
+    bool _stopping;
+    std::atomic<bool> _failed;
+    std::thread _flusher;
+};
+
+#endif /* SessionJournal_hpp */
@@ -0,0 +1,535 @@
+//
+//  SessionStore.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "SessionStore.hpp"
+
+#include "BinaryFormat.hpp"
+#include "SessionJournal.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using BinaryFormat::loadU64;
+using BinaryFormat::storeU64;
+
+#pragma mark - Byte Arena
+
+uint64_t ByteArena::append(const char* text, size_t length) {
+    size_t needed = length + 1;
+    if (_chunks.empty() || _used + needed > _chunks.back()->capacity) {
+        // strings never straddle chunks; oversized ones get a chunk of their own
+        std::shared_ptr<ByteArenaChunk> chunk = std::make_shared<ByteArenaChunk>();
+        chunk->capacity = needed > k_chunkBytes ? needed : k_chunkBytes;
+        chunk->bytes.reset(new char[chunk->capacity]);
+        std::lock_guard<std::mutex> lock(_directoryMutex);
+        _chunks.push_back(chunk);
+        _used = 0;
+    }
+    char* destination = _chunks.back()->bytes.get() + _used;
+    memcpy(destination, text, length);
+    destination[length] = '\0';
+    uint64_t reference = (static_cast<uint64_t>(_chunks.size() - 1) << 32) | _used;
+    _used += needed;
+    return reference;
+}
+
+const char* ByteArena::resolveLocal(uint64_t reference) const {
+    return _chunks[reference >> 32]->bytes.get() + (reference & 0xffffffffu);
+}
+
+void ByteArena::clearLocked() {
+    _chunks.clear();
+    _used = 0;
+}
+
+size_t ByteArena::memoryUsageLocked() const {
+    size_t bytes = 0;
+    for (const std::shared_ptr<ByteArenaChunk>& chunk : _chunks) {
+        bytes += sizeof(ByteArenaChunk) + chunk->capacity;
+    }
+    return bytes;
+}
+
+ByteArena::Snapshot ByteArena::snapshotLocked() const {
+    Snapshot snapshot;
+    snapshot._chunks.assign(_chunks.begin(), _chunks.end());
+    return snapshot;
+}
+
+#pragma mark - String Interner
+
+const uint32_t StringInterner::k_notFound;
+
+uint32_t StringInterner::hash(const char* text, size_t length) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<unsigned char>(text[i])) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t StringInterner::find(const char* text, size_t length, uint32_t hash) const {
+    if (_table.empty()) {
+        return k_notFound;
+    }
+    size_t mask = _table.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Entry& entry = _table[i];
+        if (entry.id == k_notFound) {
+            return k_notFound;
+        }
+        if (entry.hash == hash && entry.length == length && memcmp(entry.text, text, length) == 0) {
+            return entry.id;
+        }
+    }
+}
+
+void StringInterner::insert(uint32_t id, const char* storedText, uint32_t hash) {
+    if ((_count + 1) * 2 > _table.size()) {
+        grow();
+    }
+    size_t mask = _table.size() - 1;
+    size_t i = hash & mask;
+    while (_table[i].id != k_notFound) {
+        i = (i + 1) & mask;
+    }
+    _table[i] = Entry{hash, id, storedText, strlen(storedText)};
+    _count++;
+}
+
+void StringInterner::grow() {
+    std::vector<Entry> old;
+    old.swap(_table);
+    _table.assign(old.empty() ? 16 : old.size() * 2, Entry{0, k_notFound, nullptr, 0});
+    _count = 0;
+    for (const Entry& entry : old) {
+        if (entry.id != k_notFound) {
+            insert(entry.id, entry.text, entry.hash);
+        }
+    }
+}
+
+void StringInterner::clear() {
+    _table.clear();
+    _count = 0;
+}
+
+#pragma mark - Sealed Chunks
+
+// A sealed chunk stores its columns one after the other, each bit-packed against a frame of
+// reference: the column's minimum (i64) and bit width (u8), then every value minus the minimum
+// in that many bits, least significant first, and 8 bytes of padding so decoding can always
+// load a whole word. Times are stored as the change of the delta from the previous record,
+// which a steady stream packs into a few bits; milestones as deltas. Telemetry fields are
+// copied raw, but only as many as each record has.
+namespace {
+
+const int k_maxPackedWidth = 56;    // wider columns are stored as whole words
+const size_t k_columnPadding = 8;
+
+class ChunkEncoder {
+public:
+    explicit ChunkEncoder(std::vector<unsigned char>& out) : _out(out) {}
+
+    void column(const int64_t* values, size_t count) {
+        int64_t minimum = values[0];
+        int64_t maximum = values[0];
+        for (size_t i = 1; i < count; i++) {
+            minimum = std::min(minimum, values[i]);
+            maximum = std::max(maximum, values[i]);
+        }
+        uint64_t range = static_cast<uint64_t>(maximum) - static_cast<uint64_t>(minimum);
+        int width = 0;
+        while (width < 64 && (range >> width) != 0) {
+            width++;
+        }
+        if (width > k_maxPackedWidth) {
+            width = 64;
+        }
+
+        size_t start = _out.size();
+        size_t packedBytes = (count * width + 7) / 8;
+        _out.resize(start + 9 + packedBytes + k_columnPadding, 0);
+        unsigned char* p = _out.data() + start;
+        storeU64(p, static_cast<uint64_t>(minimum));
+        p[8] = static_cast<unsigned char>(width);
+        p += 9;
+        if (width == 64) {
+            for (size_t i = 0; i < count; i++) {
+                storeU64(p + i * 8, static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(minimum));
+            }
+            return;
+        }
+        for (size_t i = 0; width > 0 && i < count; i++) {
+            uint64_t value = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(minimum);
+            size_t bit = i * width;
+            storeU64(p + bit / 8, loadU64(p + bit / 8) | (value << (bit % 8)));
+        }
+    }
+
+    void bytes(const void* data, size_t size) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        _out.insert(_out.end(), p, p + size);
+    }
+
+private:
+    std::vector<unsigned char>& _out;
+};
+
+class ChunkDecoder {
+public:
+    explicit ChunkDecoder(const SealedChunk& sealed) : _p(sealed.bytes.get()) {}
+
+    void column(int64_t* values, size_t count) {
+        const unsigned char* p = _p;
+        uint64_t minimum = loadU64(p);
+        int width = p[8];
+        p += 9;
+        if (width == 64) {
+            for (size_t i = 0; i < count; i++) {
+                values[i] = static_cast<int64_t>(minimum + loadU64(p + i * 8));
+            }
+        } else {
+            uint64_t mask = (1ull << width) - 1;
+            size_t bit = 0;
+            for (size_t i = 0; i < count; i++, bit += width) {
+                values[i] = static_cast<int64_t>(minimum + ((loadU64(p + bit / 8) >> (bit % 8)) & mask));
+            }
+        }
+        _p = p + (count * width + 7) / 8 + k_columnPadding;
+    }
+
+    void bytes(void* data, size_t size) {
+        memcpy(data, _p, size);
+        _p += size;
+    }
+
+private:
+    const unsigned char* _p;
+};
+
+template <typename T, size_t N>
+void widen(const T (&column)[N], int64_t (&values)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        values[i] = static_cast<int64_t>(column[i]);
+    }
+}
+
+template <typename T, size_t N>
+void narrow(const int64_t (&values)[N], T (&column)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        column[i] = static_cast<T>(values[i]);
+    }
+}
+
+// In place: values become the change of delta from the previous value, and back.
+template <size_t N>
+void toDeltaOfDelta(int64_t (&values)[N]) {
+    int64_t previous = 0;
+    int64_t previousDelta = 0;
+    for (size_t i = 0; i < N; i++) {
+        int64_t delta = values[i] - previous;
+        previous = values[i];
+        values[i] = delta - previousDelta;
+        previousDelta = delta;
+    }
+}
+
+template <size_t N>
+void fromDeltaOfDelta(int64_t (&values)[N]) {
+    int64_t previous = 0;
+    int64_t delta = 0;
+    for (size_t i = 0; i < N; i++) {
+        delta += values[i];
+        previous += delta;
+        values[i] = previous;
+    }
+}
+
+template <size_t N>
+void toDelta(int64_t (&values)[N]) {
+    for (size_t i = N - 1; i > 0; i--) {
+        values[i] -= values[i - 1];
+    }
+}
+
+template <size_t N>
+void fromDelta(int64_t (&values)[N]) {
+    for (size_t i = 1; i < N; i++) {
+        values[i] += values[i - 1];
+    }
+}
+
+} // namespace
+
+void ReactionChunk::encode(const ReactionChunk& chunk, std::vector<unsigned char>& out) {
+    ChunkEncoder encoder(out);
+    int64_t values[k_capacity];
+    widen(chunk.sinceStart, values);
+    toDeltaOfDelta(values);
+    encoder.column(values, k_capacity);
+    encoder.column(chunk.reactionTime, k_capacity);
+    encoder.column(chunk.callbackDuration, k_capacity);
+    widen(chunk.milestone, values);
+    toDelta(values);
+    encoder.column(values, k_capacity);
+    widen(chunk.position, values);
+    encoder.column(values, k_capacity);
+    widen(chunk.channel, values);
+    encoder.column(values, k_capacity);
+    widen(chunk.outcome, values);
+    encoder.column(values, k_capacity);
+}
+
+void ReactionChunk::decode(const SealedChunk& sealed, ReactionChunk& chunk) {
+    ChunkDecoder decoder(sealed);
+    int64_t values[k_capacity];
+    decoder.column(chunk.sinceStart, k_capacity);
+    fromDeltaOfDelta(chunk.sinceStart);
+    decoder.column(chunk.reactionTime, k_capacity);
+    decoder.column(chunk.callbackDuration, k_capacity);
+    decoder.column(values, k_capacity);
+    fromDelta(values);
+    narrow(values, chunk.milestone);
+    decoder.column(values, k_capacity);
+    narrow(values, chunk.position);
+    decoder.column(values, k_capacity);
+    narrow(values, chunk.channel);
+    decoder.column(values, k_capacity);
+    narrow(values, chunk.outcome);
+}
+
+void EventChunk::encode(const EventChunk& chunk, std::vector<unsigned char>& out) {
+    ChunkEncoder encoder(out);
+    int64_t values[k_capacity];
+    widen(chunk.sinceStart, values);
+    toDeltaOfDelta(values);
+    encoder.column(values, k_capacity);
+    widen(chunk.milestone, values);
+    toDelta(values);
+    encoder.column(values, k_capacity);
+    widen(chunk.name, values);
+    encoder.column(values, k_capacity);
+}
+
+void EventChunk::decode(const SealedChunk& sealed, EventChunk& chunk) {
+    ChunkDecoder decoder(sealed);
+    int64_t values[k_capacity];
+    decoder.column(chunk.sinceStart, k_capacity);
+    fromDeltaOfDelta(chunk.sinceStart);
+    decoder.column(values, k_capacity);
+    fromDelta(values);
+    narrow(values, chunk.milestone);
+    decoder.column(values, k_capacity);
+    narrow(values, chunk.name);
+}
+
+void TelemetryChunk::encode(const TelemetryChunk& chunk, std::vector<unsigned char>& out) {
+    ChunkEncoder encoder(out);
+    int64_t values[k_capacity];
+    widen(chunk.sinceStart, values);
+    toDeltaOfDelta(values);
+    encoder.column(values, k_capacity);
+    widen(chunk.milestone, values);
+    toDelta(values);
+    encoder.column(values, k_capacity);
+    widen(chunk.id, values);
+    encoder.column(values, k_capacity);
+    widen(chunk.fieldCount, values);
+    encoder.column(values, k_capacity);
+    for (size_t i = 0; i < k_capacity; i++) {
+        for (uint32_t field = 0; field < chunk.fieldCount[i]; field++) {
+            encoder.bytes(&chunk.fields[field][i], sizeof(float));
+        }
+    }
+}
+
+void TelemetryChunk::decode(const SealedChunk& sealed, TelemetryChunk& chunk) {
+    ChunkDecoder decoder(sealed);
+    int64_t values[k_capacity];
+    decoder.column(chunk.sinceStart, k_capacity);
+    fromDeltaOfDelta(chunk.sinceStart);
+    decoder.column(values, k_capacity);
+    fromDelta(values);
+    narrow(values, chunk.milestone);
+    decoder.column(values, k_capacity);
+    narrow(values, chunk.id);
+    decoder.column(values, k_capacity);
+    narrow(values, chunk.fieldCount);
+    for (size_t i = 0; i < k_capacity; i++) {
+        for (uint32_t field = 0; field < chunk.fieldCount[i]; field++) {
+            decoder.bytes(&chunk.fields[field][i], sizeof(float));
+        }
+    }
+}
+
+#pragma mark - Session Store
+
+const uint32_t SessionStore::k_noPosition;
+const uint32_t TelemetrySample::k_maxFields;
+
+SessionStore::SessionStore() :
+    _reactions(_directoryMutex),
+    _events(_directoryMutex),
+    _telemetry(_directoryMutex),
+    _positions(_directoryMutex),
+    _eventNames(_directoryMutex),
+    _text(_directoryMutex),
+    _epoch(0),
+    _journal(nullptr)
+{
+    internPosition("");
+}
+
+uint32_t SessionStore::internPosition(const char* position) {
+    size_t length = strlen(position);
+    uint32_t hash = StringInterner::hash(position, length);
+    uint32_t id = _positionIds.find(position, length, hash);
+    if (id != StringInterner::k_notFound) {
+        return id;
+    }
+    uint64_t reference = _text.append(position, length);
+    size_t slot;
+    StringChunk& chunk = _positions.beginAppend(slot);
+    chunk.text[slot] = reference;
+    _positions.commitAppend();
+    id = static_cast<uint32_t>(_positions.size() - 1);
+    _positionIds.insert(id, _text.resolveLocal(reference), hash);
+    if (_journal != nullptr) {
+        _journal->appendPosition(id, position);
+    }
+    return id;
+}
+
+void SessionStore::appendReaction(int64_t sinceStart, int64_t reactionTime, int64_t callbackDuration, uint32_t milestone, uint32_t position, uint32_t channel,
+                                  uint32_t outcome) {
+    size_t slot;
+    ReactionChunk& chunk = _reactions.beginAppend(slot);
+    chunk.sinceStart[slot] = sinceStart;
+    chunk.reactionTime[slot] = reactionTime;
+    chunk.callbackDuration[slot] = callbackDuration;
+    chunk.milestone[slot] = milestone;
+    chunk.position[slot] = position;
+    chunk.channel[slot] = static_cast<uint8_t>(channel);
+    chunk.outcome[slot] = static_cast<uint8_t>(outcome);
+    _reactions.commitAppend();
+    if (_journal != nullptr) {
+        _journal->appendReaction(sinceStart, reactionTime, callbackDuration, milestone, position, channel, outcome);
+    }
+}
+
+void SessionStore::appendEvent(int64_t sinceStart, uint32_t milestone, const char* name) {
+    size_t length = strlen(name);
+    uint32_t hash = StringInterner::hash(name, length);
+    uint32_t nameId = _eventNameIds.find(name, length, hash);
+    if (nameId == StringInterner::k_notFound) {
+        uint64_t reference = _text.append(name, length);
+        size_t slot;
+        StringChunk& chunk = _eventNames.beginAppend(slot);
+        chunk.text[slot] = reference;
+        _eventNames.commitAppend();
+        nameId = static_cast<uint32_t>(_eventNames.size() - 1);
+        _eventNameIds.insert(nameId, _text.resolveLocal(reference), hash);
+    }
+    size_t slot;
+    EventChunk& chunk = _events.beginAppend(slot);
+    chunk.sinceStart[slot] = sinceStart;
+    chunk.milestone[slot] = milestone;
+    chunk.name[slot] = nameId;
+    _events.commitAppend();
+    if (_journal != nullptr) {
+        _journal->appendEvent(sinceStart, milestone, name);
+    }
+}
+
+void SessionStore::appendTelemetry(int64_t sinceStart, uint32_t milestone, const TelemetrySample* samples, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const TelemetrySample& sample = samples[i];
+        uint32_t fieldCount = std::min(sample.fieldCount, TelemetrySample::k_maxFields);
+        size_t slot;
+        TelemetryChunk& chunk = _telemetry.beginAppend(slot);
+        chunk.sinceStart[slot] = sinceStart;
+        chunk.milestone[slot] = milestone;
+        chunk.id[slot] = sample.id;
+        chunk.fieldCount[slot] = static_cast<uint8_t>(fieldCount);
+        for (uint32_t field = 0; field < fieldCount; field++) {
+            chunk.fields[field][slot] = sample.fields[field];
+        }
+        _telemetry.commitAppend();
+        if (_journal != nullptr) {
+            _journal->appendTelemetry(sinceStart, milestone, sample.id, sample.fields, fieldCount);
+        }
+    }
+}
+
+void SessionStore::clear() {
+    if (_journal != nullptr) {
+        _journal->appendClear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_directoryMutex);
+        _reactions.clearLocked();
+        _events.clearLocked();
+        _telemetry.clearLocked();
+        _positions.clearLocked();
+        _eventNames.clearLocked();
+        _text.clearLocked();
+        _epoch.fetch_add(1, std::memory_order_acq_rel);
+    }
+    _positionIds.clear();
+    _eventNameIds.clear();
+    internPosition("");
+}
+
+void SessionStore::setJournal(SessionJournal* journal) {
+    _journal = journal;
+    if (journal == nullptr) {
+        return;
+    }
+    Snapshot current = snapshot();
+    journal->appendClear();
+    for (size_t id = current.positions.begin(); id < current.positions.end(); id++) {
+        journal->appendPosition(static_cast<uint32_t>(id), current.position(static_cast<uint32_t>(id)));
+    }
+    for (size_t i = current.reactions.begin(); i < current.reactions.end(); i++) {
+        const ReactionChunk& chunk = current.reactions.chunk(i);
+        size_t slot = current.reactions.slot(i);
+        journal->appendReaction(chunk.sinceStart[slot], chunk.reactionTime[slot], chunk.callbackDuration[slot], chunk.milestone[slot], chunk.position[slot],
+                                chunk.channel[slot], chunk.outcome[slot]);
+    }
+    for (size_t i = current.events.begin(); i < current.events.end(); i++) {
+        const EventChunk& chunk = current.events.chunk(i);
+        size_t slot = current.events.slot(i);
+        journal->appendEvent(chunk.sinceStart[slot], chunk.milestone[slot], current.eventName(chunk.name[slot]));
+    }
+    for (size_t i = current.telemetry.begin(); i < current.telemetry.end(); i++) {
+        const TelemetryChunk& chunk = current.telemetry.chunk(i);
+        size_t slot = current.telemetry.slot(i);
+        float fields[TelemetrySample::k_maxFields];
+        for (uint32_t field = 0; field < chunk.fieldCount[slot]; field++) {
+            fields[field] = chunk.fields[field][slot];
+        }
+        journal->appendTelemetry(chunk.sinceStart[slot], chunk.milestone[slot], chunk.id[slot], fields, chunk.fieldCount[slot]);
+    }
+}
+
+SessionStore::Snapshot SessionStore::snapshot(size_t reactionsFrom, size_t eventsFrom, size_t telemetryFrom) const {
+    std::lock_guard<std::mutex> lock(_directoryMutex);
+    Snapshot snapshot;
+    snapshot.reactions = _reactions.snapshotLocked(reactionsFrom);
+    snapshot.events = _events.snapshotLocked(eventsFrom);
+    snapshot.telemetry = _telemetry.snapshotLocked(telemetryFrom);
+    snapshot.positions = _positions.snapshotLocked(0);
+    snapshot.eventNames = _eventNames.snapshotLocked(0);
+    snapshot.text = _text.snapshotLocked();
+    snapshot.epoch = _epoch.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+size_t SessionStore::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(_directoryMutex);
+    return _reactions.memoryUsageLocked() + _events.memoryUsageLocked() + _telemetry.memoryUsageLocked() +
+           _positions.memoryUsageLocked() + _eventNames.memoryUsageLocked() + _text.memoryUsageLocked();
+}
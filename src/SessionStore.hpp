@@ -0,0 +1,421 @@
+//
+//  SessionStore.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef SessionStore_hpp
+#define SessionStore_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class SessionJournal;
+
+// Compressed copy of a full column chunk.
+struct SealedChunk {
+    std::unique_ptr<unsigned char[]> bytes;
+    size_t size;
+};
+
+// How a ColumnLog seals its chunks: with the chunk's own encode and decode,
+// unless a specialisation opts the chunk out.
+template <typename Chunk>
+struct ChunkCodec {
+    static const bool k_seals = true;
+
+    static void encode(const Chunk& chunk, std::vector<unsigned char>& out) { Chunk::encode(chunk, out); }
+    static void decode(const SealedChunk& sealed, Chunk& chunk) { Chunk::decode(sealed, chunk); }
+};
+
+// Append-only log of fixed size column chunks (struct-of-arrays inside each chunk).
+// Written by one thread; readers take snapshots that keep the chunks they need
+// alive, so they can scan without holding any lock while the writer keeps
+// appending. Records below a snapshot's end are never modified again.
+//
+// Once a chunk is full the writer seals it: ChunkCodec::encode packs it into a
+// SealedChunk (a few bytes per record instead of the full columns) and the
+// directory drops the columns. Snapshots taken before keep the columns alive;
+// later ones decode sealed chunks on demand.
+template <typename Chunk>
+class ColumnLog {
+public:
+    static const size_t k_capacity = Chunk::k_capacity;
+
+    class Snapshot {
+    public:
+        size_t begin() const { return _begin; }
+        size_t end() const { return _end; }
+        size_t size() const { return _end - _begin; }
+        bool empty() const { return _end == _begin; }
+
+        // Chunk holding record index, and the record's slot inside that chunk. A sealed chunk is
+        // decoded into a buffer of the snapshot, which holds the last two chunks asked for: the
+        // reference stays valid until chunks further back or ahead are asked for. Scan in order,
+        // and don't share one snapshot between threads.
+        const Chunk& chunk(size_t index) const {
+            size_t number = index / k_capacity;
+            const std::shared_ptr<const Chunk>& columns = _chunks[number - _firstChunk];
+            if (columns != nullptr) {
+                return *columns;
+            }
+            return _decoded.get(number, *_sealed[number - _firstChunk]);
+        }
+        static size_t slot(size_t index) { return index % k_capacity; }
+
+        // Scans [begin(), end()) a chunk at a time, which decodes each sealed chunk once:
+        // visit(chunk, firstSlot, endSlot) for every chunk's share of the records, in order.
+        template <typename Visit>
+        void forEachChunk(Visit visit) const {
+            for (size_t index = _begin; index < _end; ) {
+                size_t first = slot(index);
+                size_t last = _end - index < k_capacity - first ? first + (_end - index) : k_capacity;
+                visit(chunk(index), first, last);
+                index += last - first;
+            }
+        }
+
+    private:
+        // Copies start out empty, so copies of a snapshot can be read on different threads.
+        class DecodedChunks {
+        public:
+            DecodedChunks() {}
+            DecodedChunks(DecodedChunks const&) {}
+            DecodedChunks& operator=(DecodedChunks const&) { return *this; }
+
+            const Chunk& get(size_t number, const SealedChunk& sealed) {
+                for (Entry& entry : _entries) {
+                    if (entry.chunk != nullptr && entry.number == number) {
+                        return *entry.chunk;
+                    }
+                }
+                Entry& entry = _entries[_next];
+                _next ^= 1;
+                if (entry.chunk == nullptr) {
+                    entry.chunk.reset(new Chunk);
+                }
+                ChunkCodec<Chunk>::decode(sealed, *entry.chunk);
+                entry.number = number;
+                return *entry.chunk;
+            }
+
+        private:
+            struct Entry {
+                size_t number = 0;
+                std::unique_ptr<Chunk> chunk;
+            };
+            Entry _entries[2];
+            size_t _next = 0;
+        };
+
+        friend class ColumnLog;
+        std::vector<std::shared_ptr<const Chunk>> _chunks;        // null once sealed
+        std::vector<std::shared_ptr<const SealedChunk>> _sealed;  // null until then
+        mutable DecodedChunks _decoded;
+        size_t _firstChunk = 0;
+        size_t _begin = 0;
+        size_t _end = 0;
+    };
+
+    explicit ColumnLog(std::mutex& directoryMutex) : _directoryMutex(directoryMutex), _size(0) {}
+
+    ColumnLog(ColumnLog const&) = delete;
+    ColumnLog& operator=(ColumnLog const&) = delete;
+
+    size_t size() const { return _size.load(std::memory_order_acquire); }
+
+    // Writer only: chunk and slot of the next record. Fill every column, then commitAppend().
+    Chunk& beginAppend(size_t& slot) {
+        size_t size = _size.load(std::memory_order_relaxed);
+        slot = size % k_capacity;
+        if (size / k_capacity == _chunks.size()) {
+            std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+            std::shared_ptr<const SealedChunk> sealed;
+            if (ChunkCodec<Chunk>::k_seals && !_chunks.empty()) {
+                sealed = seal(*_chunks.back());
+            }
+            std::lock_guard<std::mutex> lock(_directoryMutex);
+            if (sealed != nullptr) {
+                _sealed.back() = sealed;
+                _chunks.back().reset();
+            }
+            _chunks.push_back(chunk);
+            _sealed.push_back(nullptr);
+        }
+        return *_chunks[size / k_capacity];
+    }
+
+    void commitAppend() {
+        _size.store(_size.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Writer only, with the directory mutex held.
+    void clearLocked() {
+        _chunks.clear();
+        _sealed.clear();
+        _size.store(0, std::memory_order_release);
+    }
+
+    // Reader, with the directory mutex held. Covers records [from, size()).
+    Snapshot snapshotLocked(size_t from) const {
+        Snapshot snapshot;
+        size_t size = _size.load(std::memory_order_acquire);
+        snapshot._begin = from < size ? from : size;
+        snapshot._end = size;
+        snapshot._firstChunk = snapshot._begin / k_capacity;
+        size_t lastChunk = (size + k_capacity - 1) / k_capacity;
+        if (lastChunk > snapshot._firstChunk) {
+            snapshot._chunks.assign(_chunks.begin() + snapshot._firstChunk, _chunks.begin() + lastChunk);
+            snapshot._sealed.assign(_sealed.begin() + snapshot._firstChunk, _sealed.begin() + lastChunk);
+        }
+        return snapshot;
+    }
+
+    // Reader, with the directory mutex held. Bytes held by the chunks, sealed or not.
+    size_t memoryUsageLocked() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < _chunks.size(); i++) {
+            bytes += _chunks[i] != nullptr ? sizeof(Chunk) : sizeof(SealedChunk) + _sealed[i]->size;
+        }
+        return bytes;
+    }
+
+private:
+    std::shared_ptr<const SealedChunk> seal(const Chunk& chunk) {
+        _encoded.clear();
+        ChunkCodec<Chunk>::encode(chunk, _encoded);
+        std::shared_ptr<SealedChunk> sealed = std::make_shared<SealedChunk>();
+        sealed->size = _encoded.size();
+        sealed->bytes.reset(new unsigned char[sealed->size]);
+        memcpy(sealed->bytes.get(), _encoded.data(), sealed->size);
+        return sealed;
+    }
+
+    std::mutex& _directoryMutex;
+    std::vector<std::shared_ptr<Chunk>> _chunks;        // null once sealed
+    std::vector<std::shared_ptr<const SealedChunk>> _sealed;
+    std::vector<unsigned char> _encoded;                // writer's scratch buffer
+    std::atomic<size_t> _size;
+};
+
+struct ByteArenaChunk {
+    std::unique_ptr<char[]> bytes;
+    size_t capacity;
+};
+
+// Append-only storage for NUL terminated strings referenced from the columns.
+// A reference packs the chunk index in the high 32 bits and the byte offset in the low 32.
+class ByteArena {
+public:
+    static const size_t k_chunkBytes = 64 * 1024;
+
+    class Snapshot {
+    public:
+        const char* resolve(uint64_t reference) const {
+            return _chunks[reference >> 32]->bytes.get() + (reference & 0xffffffffu);
+        }
+
+    private:
+        friend class ByteArena;
+        std::vector<std::shared_ptr<const ByteArenaChunk>> _chunks;
+    };
+
+    explicit ByteArena(std::mutex& directoryMutex) : _directoryMutex(directoryMutex) {}
+
+    ByteArena(ByteArena const&) = delete;
+    ByteArena& operator=(ByteArena const&) = delete;
+
+    // Writer only.
+    uint64_t append(const char* text, size_t length);
+    const char* resolveLocal(uint64_t reference) const;
+    void clearLocked();
+    Snapshot snapshotLocked() const;
+    size_t memoryUsageLocked() const;
+
+private:
+    std::mutex& _directoryMutex;
+    std::vector<std::shared_ptr<ByteArenaChunk>> _chunks;
+    size_t _used = 0;
+};
+
+// Writer side lookup for interned strings. Ids are dense and index the
+// dictionary column; the strings themselves live in the arena.
+class StringInterner {
+public:
+    StringInterner() {}
+
+    StringInterner(StringInterner const&) = delete;
+    StringInterner& operator=(StringInterner const&) = delete;
+
+    // Id of text, or k_notFound. No allocation, so safe on the response path.
+    uint32_t find(const char* text, size_t length, uint32_t hash) const;
+    void insert(uint32_t id, const char* storedText, uint32_t hash);
+    void clear();
+
+    static uint32_t hash(const char* text, size_t length);
+
+    static const uint32_t k_notFound = 0xffffffffu;
+
+private:
+    void grow();
+
+    struct Entry {
+        uint32_t hash;
+        uint32_t id;
+        const char* text;       // points into the arena, never moves
+        size_t length;
+    };
+
+    std::vector<Entry> _table;  // open addressing, id == k_notFound marks a free slot
+    size_t _count = 0;
+};
+
+// How a stimulus ended. Stored with its reaction rather than told from the reaction time or
+// position, which a timeout and a false start can share.
+struct ReactionOutcome {
+    enum {
+        Response,
+        Timeout,
+        FalseStart,     // answered faster than humanly possible
+        Count
+    };
+};
+
+// All times are microseconds since the measurement started.
+struct ReactionChunk {
+    static const size_t k_capacity = 1024;
+
+    int64_t sinceStart[k_capacity];
+    int64_t reactionTime[k_capacity];
+    int64_t callbackDuration[k_capacity];
+    uint32_t milestone[k_capacity];
+    uint32_t position[k_capacity];      // interned position id
+    uint8_t channel[k_capacity];        // stimulus channel index
+    uint8_t outcome[k_capacity];        // ReactionOutcome
+
+    static void encode(const ReactionChunk& chunk, std::vector<unsigned char>& out);
+    static void decode(const SealedChunk& sealed, ReactionChunk& chunk);
+};
+
+struct EventChunk {
+    static const size_t k_capacity = 1024;
+
+    int64_t sinceStart[k_capacity];
+    uint32_t milestone[k_capacity];
+    uint32_t name[k_capacity];          // interned event name id
+
+    static void encode(const EventChunk& chunk, std::vector<unsigned char>& out);
+    static void decode(const SealedChunk& sealed, EventChunk& chunk);
+};
+
+// One typed event: an id chosen by the host and up to k_maxFields numbers.
+struct TelemetrySample {
+    static const uint32_t k_maxFields = 8;
+
+    uint32_t id;
+    uint32_t fieldCount;
+    float fields[k_maxFields];
+};
+
+struct TelemetryChunk {
+    static const size_t k_capacity = 1024;
+
+    int64_t sinceStart[k_capacity];
+    uint32_t milestone[k_capacity];
+    uint32_t id[k_capacity];
+    uint8_t fieldCount[k_capacity];
+    float fields[TelemetrySample::k_maxFields][k_capacity];
+
+    static void encode(const TelemetryChunk& chunk, std::vector<unsigned char>& out);
+    static void decode(const SealedChunk& sealed, TelemetryChunk& chunk);
+};
+
+// Dictionary of interned strings, indexed by id.
+struct StringChunk {
+    static const size_t k_capacity = 256;
+
+    uint64_t text[k_capacity];          // ByteArena reference
+};
+
+// Dictionaries are small and looked up at random, so they stay as they are.
+template <>
+struct ChunkCodec<StringChunk> {
+    static const bool k_seals = false;
+
+    static void encode(const StringChunk&, std::vector<unsigned char>&) {}
+    static void decode(const SealedChunk&, StringChunk&) {}
+};
+
+// Collected data of one session. The executor appends, exports read snapshots.
+class SessionStore {
+public:
+    typedef ColumnLog<ReactionChunk> ReactionLog;
+    typedef ColumnLog<EventChunk> EventLog;
+    typedef ColumnLog<TelemetryChunk> TelemetryLog;
+    typedef ColumnLog<StringChunk> StringLog;
+
+    // Id of the empty position, recorded when a stimulus times out.
+    static const uint32_t k_noPosition = 0;
+
+    struct Snapshot {
+        ReactionLog::Snapshot reactions;
+        EventLog::Snapshot events;
+        TelemetryLog::Snapshot telemetry;
+        StringLog::Snapshot positions;
+        StringLog::Snapshot eventNames;
+        ByteArena::Snapshot text;
+        uint32_t epoch = 0;             // see SessionStore::epoch()
+
+        const char* position(uint32_t id) const {
+            return text.resolve(positions.chunk(id).text[positions.slot(id)]);
+        }
+        const char* eventName(uint32_t id) const {
+            return text.resolve(eventNames.chunk(id).text[eventNames.slot(id)]);
+        }
+    };
+
+    SessionStore();
+
+    SessionStore(SessionStore const&) = delete;
+    SessionStore& operator=(SessionStore const&) = delete;
+
+    // Writer only.
+    // Mirrors every later write to journal, after writing out what is stored now. Null stops journaling.
+    void setJournal(SessionJournal* journal);
+    uint32_t internPosition(const char* position);
+    void appendReaction(int64_t sinceStart, int64_t reactionTime, int64_t callbackDuration, uint32_t milestone, uint32_t position, uint32_t channel,
+                        uint32_t outcome);
+    void appendEvent(int64_t sinceStart, uint32_t milestone, const char* name);
+    // Every sample gets the same time; fields past k_maxFields are dropped.
+    void appendTelemetry(int64_t sinceStart, uint32_t milestone, const TelemetrySample* samples, size_t count);
+    void clear();
+
+    // Any thread. Consistent view of the records appended so far, starting at the given indices.
+    Snapshot snapshot(size_t reactionsFrom = 0, size_t eventsFrom = 0, size_t telemetryFrom = 0) const;
+
+    // Bumped by every clear(), so record indices remembered by a reader can be
+    // told apart from the same indices after the session was restarted.
+    uint32_t epoch() const { return _epoch.load(std::memory_order_acquire); }
+
+    // Any thread. Bytes held by the records and their strings.
+    size_t memoryUsage() const;
+
+private:
+    mutable std::mutex _directoryMutex;   // only taken when a chunk is added, on clear and by snapshots
+    ReactionLog _reactions;
+    EventLog _events;
+    TelemetryLog _telemetry;
+    StringLog _positions;
+    StringInterner _positionIds;
+    StringLog _eventNames;
+    StringInterner _eventNameIds;
+    ByteArena _text;
+    std::atomic<uint32_t> _epoch;
+    SessionJournal* _journal;
+};
+
+#endif /* SessionStore_hpp */
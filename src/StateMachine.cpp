@@ -7,53 +7,30 @@
 
 #include "StateMachine.hpp"
 
+#include "CallMetrics.hpp"
+
+#include <algorithm>
 #include <assert.h>
 #include <cmath>
-#include <functional>
-#include <stdarg.h>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
 #include <stdlib.h>
 #include <string>
-#include <thread>
-
-class Timer
-{
-    std::atomic<bool> running{false};
-
-public:
-    typedef std::chrono::milliseconds Interval;
-    typedef std::function<void(void)> Timeout;
-
-    void start(const Interval &interval,
-               const Timeout &timeout)
-    {
-        running = true;
-
-        std::thread t([=]() {
-            if(!running.load()) { return; }
-            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
-            if(!running.load()) { return; }
-            timeout();
-        });
-        t.detach();
-    }
-
-    void stop()
-    {
-        running = false;
-    }
-};
 
 static const unsigned k_maxSignalSeconds = 25;
 static const unsigned k_minSignalSeconds = 15;
 static const unsigned k_responseTimeoutSeconds = 5;
-
-static Timer s_signalTimeElapsedTimer;
-static Timer s_responseTimeoutTimer;
+static const int64_t k_minHumanReactionMicroseconds = 100000;
+static const int64_t k_nanosecondsPerSecond = 1000000000;
+// what a missed or too early response is recorded as, whatever the channel's timeout
+static const int64_t k_missedReactionMicroseconds = k_responseTimeoutSeconds * 1000000;
 
 
 #pragma mark - Auxiliary Functions
 
-std::string stateToString(int state) {
+
+static const char* stateToString(int state) {
     switch (state) { 
         case State::WaitForStart:
             return "WaitForStart";
@@ -70,7 +47,7 @@ std::string stateToString(int state) {
     }
 }
 
-std::string eventToString(int eventId) {
+static const char* eventToString(int eventId) {
     switch (eventId) {
         case Event::StartMeasure:
             return "StartMeasure";
@@ -89,151 +66,931 @@ std::string eventToString(int eventId) {
     }
 }
 
+#pragma mark - Transition Table
+
+static const int k_noEvent = -1;
+static const int k_invalidTransition = -1;
+
+static constexpr StateMachine::Transition k_transitions[] = {
+    // start
+    {Event::StartMeasure, State::WaitForStart, State::Idle},
+    // default flow
+    {Event::SignalTimeElapsed, State::Idle, State::SendSignal},
+    {Event::SignalSent, State::SendSignal, State::WaitResponse},
+    {Event::ResponseReceived, State::WaitResponse, State::ProcessResponse},
+    {Event::ResponseProcessed, State::ProcessResponse, State::Idle},
+    // response never came
+    {Event::ResponseTimeout, State::WaitResponse, State::ProcessResponse}
+};
+
+// Next state for every [event][state] pair, k_invalidTransition where the event isn't accepted.
+struct TransitionTable {
+    int8_t next[Event::Count][State::Count];
+};
+
+// Throwing during constant evaluation turns a bad transition list into a compile error.
+template <size_t Count>
+static constexpr TransitionTable makeTransitionTable(const StateMachine::Transition (&transitions)[Count]) {
+    TransitionTable table{};
+    for (int event = 0; event < Event::Count; event++) {
+        for (int state = 0; state < State::Count; state++) {
+            table.next[event][state] = k_invalidTransition;
+        }
+    }
+    for (size_t i = 0; i < Count; i++) {
+        const StateMachine::Transition& transition = transitions[i];
+        if (transition.eventId < 0 || transition.eventId >= Event::Count ||
+            transition.validState < 0 || transition.validState >= State::Count ||
+            transition.nextState < 0 || transition.nextState >= State::Count) {
+            throw "transition refers to an unknown event or state";
+        }
+        if (table.next[transition.eventId][transition.validState] != k_invalidTransition) {
+            throw "two transitions for the same event and state";
+        }
+        table.next[transition.eventId][transition.validState] = static_cast<int8_t>(transition.nextState);
+    }
+    return table;
+}
+
+static constexpr bool allStatesReachable(const TransitionTable& table, int initialState) {
+    bool reached[State::Count] = {};
+    reached[initialState] = true;
+    for (bool grew = true; grew; ) {
+        grew = false;
+        for (int event = 0; event < Event::Count; event++) {
+            for (int state = 0; state < State::Count; state++) {
+                int next = table.next[event][state];
+                if (reached[state] && next != k_invalidTransition && !reached[next]) {
+                    reached[next] = true;
+                    grew = true;
+                }
+            }
+        }
+    }
+    for (int state = 0; state < State::Count; state++) {
+        if (!reached[state]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static constexpr TransitionTable k_transitionTable = makeTransitionTable(k_transitions);
+static_assert(allStatesReachable(k_transitionTable, State::WaitForStart), "every state must be reachable from WaitForStart");
+static_assert(Event::Count == CallMetrics::k_eventCount && State::Count == CallMetrics::k_stateCount, "CallMetrics counts every transition");
+
 #pragma mark - State Machine
 
 StateMachine& StateMachine::GetInstance() {
-    static StateMachine instance;
-    return instance;
+    // Intentionally leaked like the timer scheduler: its executor thread must not be joined while the plugin unloads.
+    static StateMachine* instance = new StateMachine();
+    return *instance;
+}
+
+StimulusChannel::StimulusChannel(TimeSource& timeSource, uint32_t channelIndex) :
+    index(channelIndex),
+    state(State::WaitForStart),
+    awaitingPresent(false),
+    signalSendingCallback(nullptr),
+    signalStopCallback(nullptr),
+    schedule(new StimulusSchedule(StimulusSchedule::uniform(k_minSignalSeconds * k_nanosecondsPerSecond,
+                                                            k_maxSignalSeconds * k_nanosecondsPerSecond))),
+    responseTimeout(k_responseTimeoutSeconds * k_nanosecondsPerSecond),
+    signalTimeElapsedTimer(timeSource),
+    responseTimeoutTimer(timeSource),
+    nextStimulusDeadline(-1),
+    pollMode(false),
+    stimulusVisible(false),
+    sentSignalTimestamp(0),
+    signalCallbackDuration(0),
+    responseTimeoutDeadline(0),
+    previousPositionId(SessionStore::k_noPosition)
+{
 }
 
-StateMachine::StateMachine() {
-    std::srand(static_cast<unsigned>(std::time(nullptr))); // Initialize random number generator.
+StateMachine::StateMachine(bool virtualTime) :
+    _virtualTime(virtualTime ? new VirtualTimeSource() : nullptr),
+    _timeSource(virtualTime ? static_cast<TimeSource&>(*_virtualTime) : TimerScheduler::GetInstance())
+{
+    // Initialize random number generator, distinct per session even when created in the same second.
+    _seed = static_cast<uint64_t>(std::time(nullptr)) ^ static_cast<uint64_t>(reinterpret_cast<uintptr_t>(this));
+    _channels[0].reset(new StimulusChannel(_timeSource, 0));
+    _channelCount = 1;
+    _activeChannelCount = 1;
+    seedChannel(*_channels[0]);
+    for (std::atomic<int64_t>& offset : _hostClockOffsets) {
+        offset = INT64_MAX;
+    }
+    _hostClockPolls = 0;
+    _measuring = false;
     _shouldAddMilestone = true; // Start at true to create first milestone
     _shouldAddLogMilestone = true;
+    _reactionMilestoneCount = 0;
+    _eventMilestoneCount = 0;
+    _highResolutionTiming = false;
+    _exportPositionIds = false;
+    _eventTimestamp = 0;
+    _startMeasuringTimestamp = 0;
+    _tracing = false;
+    _tracedChannel = 0;
     _initialState = State::WaitForStart;
-    _state = State::WaitForStart;
-    setValidTransitions({
-        // start
-        StateMachine::Transition(Event::StartMeasure, State::WaitForStart, State::Idle),
-        // default flow
-        StateMachine::Transition(Event::SignalTimeElapsed, State::Idle, State::SendSignal),
-        StateMachine::Transition(Event::SignalSent, State::SendSignal, State::WaitResponse),
-        StateMachine::Transition(Event::ResponseReceived, State::WaitResponse, State::ProcessResponse),
-        StateMachine::Transition(Event::ResponseProcessed, State::ProcessResponse, State::Idle),
-        // response never came
-        StateMachine::Transition(Event::ResponseTimeout, State::WaitResponse, State::ProcessResponse)
-    });
-}
-
-void StateMachine::setValidTransitions(std::vector<Transition> validTransitions) {
-    _validTransitions.clear();
-    for (Transition& transition : validTransitions) {
-
-        auto it = _validTransitions.find(transition.eventId);
-        bool newEventType = it == _validTransitions.end();
-            
-        if(newEventType) {
-            _validTransitions.emplace(transition.eventId, std::vector<Transition>{transition});
-        } else {
-            it->second.emplace_back(transition);
+    _chainedEvent = k_noEvent;
+    _draining = false;
+    _journalFailed = false;
+    _executorSleeping = false;
+    _droppedCalls = 0;
+    if (!isVirtualTime()) {
+        _log.startBackgroundDrain();
+        _executor = std::thread(&StateMachine::runExecutor, this);
+    }
+}
+
+StateMachine::~StateMachine() {
+    // The commands still queued run first and may re-arm timers, so the executor is joined
+    // before the timers are cancelled. Nothing arms them after that; releasing the channels here,
+    // before the members they submit into are destroyed, ends every pending timeout for good.
+    Command command;
+    command.type = Command::Shutdown;
+    submit(command);
+    if (_executor.joinable()) {
+        _executor.join();
+    }
+    for (uint32_t i = 0; i < channelCount(); i++) {
+        _channels[i]->signalTimeElapsedTimer.stop();
+        _channels[i]->responseTimeoutTimer.stop();
+    }
+    for (std::unique_ptr<StimulusChannel>& channel : _channels) {
+        channel.reset();
+    }
+}
+
+#pragma mark - Command Submission
+
+static void setCommandText(Command& command, const char* text) {
+    size_t length = text != nullptr ? strlen(text) : 0;
+    if (length < Command::k_inlineTextCapacity) {
+        memcpy(command.text, text != nullptr ? text : "", length + 1);
+        command.heapText = nullptr;
+    } else {
+        command.heapText = new char[length + 1];
+        memcpy(command.heapText, text, length + 1);
+    }
+}
+
+static const char* commandText(const Command& command) {
+    return command.heapText != nullptr ? command.heapText : command.text;
+}
+
+// Waits for room in a full ring. Only for the commands something waits on or hands over:
+// barriers, tasks, shutdown, channels and the journal.
+void StateMachine::submit(Command& command) {
+    command.timestamp = _timeSource.now();
+    _commands.push(command);
+    wakeExecutor();
+}
+
+// For the timer thread: waiting for a full ring there while the scheduler holds its dispatch
+// lock would deadlock against an executor cancelling a timer. Virtual sessions drain each
+// command right away, so their ring never fills.
+bool StateMachine::trySubmit(Command& command) {
+    if (isVirtualTime()) {
+        submit(command);
+        return true;
+    }
+    command.timestamp = _timeSource.now();
+    if (!_commands.tryPush(command)) {
+        return false;
+    }
+    wakeExecutor();
+    return true;
+}
+
+void StateMachine::wakeExecutor() {
+    if (isVirtualTime()) {
+        if (!_draining) {
+            drainCommands();
+            _log.drain(); // nothing here is real time, so messages are delivered right away
         }
+        return;
+    }
+    // pairs with the fence in waitForCommands: either the executor sees the command or we see it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_executorSleeping.load(std::memory_order_relaxed) && _executorSleeping.exchange(false)) {
+        _wakeUp.post();
     }
 }
 
-bool StateMachine::checkState(int validState) {
-    return _state == validState;
+// The host's calls must not stall its thread behind a stalled executor, so a full ring drops
+// the call instead, with whatever it owns.
+void StateMachine::submitHostCall(Command& command) {
+    if (trySubmit(command)) {
+        return;
+    }
+    delete[] command.heapText;
+    delete[] command.telemetryBatch;
+    delete command.schedule;
+    _droppedCalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void StateMachine::submitEvent(int eventId) {
+    Command command;
+    command.type = Command::ProcessEvent;
+    command.eventId = eventId;
+    submitHostCall(command);
+}
+
+bool StateMachine::submitTimerEvent(int eventId, uint32_t channel, uint32_t generation) {
+    Command command;
+    command.type = Command::TimerElapsed;
+    command.eventId = eventId;
+    command.channel = channel;
+    command.timerGeneration = generation;
+    return trySubmit(command);
+}
+
+void StateMachine::submitResponse(const char* position, uint32_t channel) {
+    Command command;
+    command.type = Command::Response;
+    command.channel = channel;
+    setCommandText(command, position);
+    submitHostCall(command);
+}
+
+void StateMachine::submitLogEvent(const char* eventName) {
+    Command command;
+    command.type = Command::LogEvent;
+    setCommandText(command, eventName);
+    submitHostCall(command);
+}
+
+void StateMachine::submitTelemetry(const TelemetrySample* samples, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    Command command;
+    command.type = Command::Telemetry;
+    command.telemetryCount = count;
+    if (count == 1) {
+        command.telemetry = samples[0];
+    } else {
+        command.telemetryBatch = new TelemetrySample[count];
+        memcpy(command.telemetryBatch, samples, count * sizeof(TelemetrySample));
+    }
+    submitHostCall(command);
+}
+
+void StateMachine::submitMilestone() {
+    Command command;
+    command.type = Command::Milestone;
+    submitHostCall(command);
+}
+
+void StateMachine::submitReset() {
+    Command command;
+    command.type = Command::Reset;
+    submitHostCall(command);
+}
+
+void StateMachine::submitCallbacks(void (*signalSendingCallback)(), void (*signalStopCallback)(), void (*debugLogCallback)(const char *)) {
+    Command command;
+    command.type = Command::SetCallbacks;
+    command.signalSendingCallback = signalSendingCallback;
+    command.signalStopCallback = signalStopCallback;
+    command.debugLogCallback = debugLogCallback;
+    submitHostCall(command);
+}
+
+void StateMachine::submitChannelCallbacks(uint32_t channel, void (*signalSendingCallback)(), void (*signalStopCallback)()) {
+    Command command;
+    command.type = Command::SetChannelCallbacks;
+    command.channel = channel;
+    command.signalSendingCallback = signalSendingCallback;
+    command.signalStopCallback = signalStopCallback;
+    submitHostCall(command);
+}
+
+void StateMachine::submitJournal(std::unique_ptr<SessionJournal> journal) {
+    Command command;
+    command.type = Command::SetJournal;
+    command.journal = journal.release();
+    submit(command);
+}
+
+bool StateMachine::flushJournal() {
+    Command command;
+    command.type = Command::FlushJournal;
+    submit(command);
+    waitForPendingCommands();
+    return !_journalFailed.load(std::memory_order_relaxed);
+}
+
+void StateMachine::submitSchedule(const StimulusSchedule& schedule, uint32_t channel) {
+    Command command;
+    command.type = Command::SetSchedule;
+    command.channel = channel;
+    command.schedule = new StimulusSchedule(schedule);
+    submitHostCall(command);
+}
+
+void StateMachine::submitResponseTimeout(int64_t timeout, uint32_t channel) {
+    Command command;
+    command.type = Command::SetResponseTimeout;
+    command.channel = channel;
+    command.onset = timeout;
+    submitHostCall(command);
+}
+
+void StateMachine::submitSeed(uint64_t seed) {
+    Command command;
+    command.type = Command::SetSeed;
+    command.seed = seed;
+    submitHostCall(command);
+}
+
+int64_t StateMachine::peekNextStimulusTime(uint32_t channel) {
+    int64_t deadline = _channels[channel]->nextStimulusDeadline.load(std::memory_order_acquire);
+    if (deadline < 0) {
+        return -1;
+    }
+    int64_t remaining = deadline - _timeSource.now();
+    return remaining > 0 ? remaining : 0;
+}
+
+bool StateMachine::pollStimulus(int64_t frameTimestamp, uint32_t channel) {
+    uint32_t poll = _hostClockPolls.fetch_add(1, std::memory_order_relaxed);
+    _hostClockOffsets[poll % k_hostClockWindow].store(_timeSource.now() - frameTimestamp, std::memory_order_relaxed);
+    return _channels[channel]->stimulusVisible.load(std::memory_order_acquire);
+}
+
+void StateMachine::submitStimulusPresented(int64_t presentTimestamp, uint32_t channel) {
+    Command command;
+    command.type = Command::StimulusPresented;
+    command.channel = channel;
+    int64_t offset = INT64_MAX;
+    for (const std::atomic<int64_t>& sample : _hostClockOffsets) {
+        offset = std::min(offset, sample.load(std::memory_order_relaxed));
+    }
+    command.onset = presentTimestamp + (offset != INT64_MAX ? offset : 0);
+    submitHostCall(command);
+}
+
+void StateMachine::submitTimingReset() {
+    Command command;
+    command.type = Command::ResetTiming;
+    submitHostCall(command);
+}
+
+int StateMachine::addChannel() {
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(_channelMutex);
+        index = _channelCount.load(std::memory_order_relaxed);
+        if (index == k_maxChannels) {
+            return -1;
+        }
+        _channels[index].reset(new StimulusChannel(_timeSource, index));
+        _channelCount.store(index + 1, std::memory_order_release);
+    }
+    Command command;
+    command.type = Command::AddChannel;
+    command.channel = index;
+    submit(command);
+    return static_cast<int>(index);
 }
 
-void StateMachine::processEvent(int eventId) {
-    auto it = _validTransitions.find(eventId);
-    bool validEventFound = it != _validTransitions.end();
-    bool validTransitionFound = false;
-    
-    if (validEventFound) {
-        for (Transition& transition : it->second) {
-            validTransitionFound = checkState(transition.validState);
-            
-            if (validTransitionFound) {
-                debugLog("%s: %s -> %s", eventToString(eventId).c_str(), stateToString(_state).c_str(), stateToString(transition.nextState).c_str());
-                _state = transition.nextState;
-                processTransition(transition);
+void StateMachine::submitTask(void (*task)(StateMachine& stateMachine, void* context), void* context) {
+    Command command;
+    command.type = Command::Task;
+    command.task = task;
+    command.taskContext = context;
+    submit(command);
+}
+
+bool StateMachine::startTrace(const char* path) {
+    int64_t start = _timeSource.now();
+    std::unique_ptr<CallTrace> trace(new CallTrace(path, isVirtualTime(), start));
+    if (!trace->isOpen()) {
+        return false;
+    }
+    // the settings belong to the executor, so they are read there once the calls before this one have run
+    std::vector<TracedCall> calls;
+    if (isExecutorThread()) {
+        captureTraceStart(calls);
+    } else {
+        submitTask([](StateMachine& stateMachine, void* context) {
+                stateMachine.captureTraceStart(*static_cast<std::vector<TracedCall>*>(context));
+            }, &calls);
+        waitForPendingCommands();
+    }
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    _trace = std::move(trace);
+    _tracedChannel = 0;
+    for (const TracedCall& call : calls) {
+        _trace->writeNumbers(call.call, start, call.values.data(), call.values.size());
+        if (call.call == CallTraceFormat::SelectChannel) {
+            _tracedChannel = static_cast<uint32_t>(call.values[0]);
+        }
+    }
+    _tracing = true;
+    return true;
+}
+
+// Executor only. The calls that bring a new session to this one's settings: the seed, the
+// channels (so a replay's get the same indices) and each channel's schedule, a list one
+// rotated to start at the interval drawn next, and response timeout. In milliseconds, as
+// the entry points trace them.
+void StateMachine::captureTraceStart(std::vector<TracedCall>& calls) const {
+    const int64_t nsPerMs = 1000000;
+    calls.push_back(TracedCall{CallTraceFormat::SetStimulusSeed, {_seed}});
+    for (uint32_t i = 1; i < _activeChannelCount; i++) {
+        calls.push_back(TracedCall{CallTraceFormat::AddChannel, {}});
+    }
+    for (uint32_t i = 0; i < _activeChannelCount; i++) {
+        const StimulusChannel& channel = *_channels[i];
+        const StimulusSchedule& schedule = *channel.schedule;
+        if (i > 0) {
+            calls.push_back(TracedCall{CallTraceFormat::SelectChannel, {i}});
+        }
+        switch (schedule.kind()) {
+            case StimulusSchedule::Uniform:
+                calls.push_back(TracedCall{CallTraceFormat::SetUniformSchedule, {static_cast<uint64_t>(schedule.minimum() / nsPerMs),
+                                                                                 static_cast<uint64_t>(schedule.maximum() / nsPerMs)}});
+                break;
+            case StimulusSchedule::Exponential:
+                calls.push_back(TracedCall{CallTraceFormat::SetExponentialSchedule, {static_cast<uint64_t>(schedule.minimum() / nsPerMs),
+                                                                                     static_cast<uint64_t>(schedule.mean() / nsPerMs),
+                                                                                     static_cast<uint64_t>(schedule.maximum() / nsPerMs)}});
                 break;
+            case StimulusSchedule::List: {
+                std::vector<int64_t> intervals = schedule.upcomingIntervals();
+                TracedCall call{CallTraceFormat::SetScheduleList, {intervals.size()}};
+                for (int64_t interval : intervals) {
+                    call.values.push_back(static_cast<uint64_t>(interval / nsPerMs));
+                }
+                calls.push_back(call);
+                break;
+            }
+        }
+        calls.push_back(TracedCall{CallTraceFormat::SetResponseTimeout, {static_cast<uint64_t>(channel.responseTimeout / nsPerMs)}});
+    }
+}
+
+void StateMachine::stopTrace() {
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    _tracing = false;
+    if (_trace != nullptr) {
+        _trace->writeNumbers(CallTraceFormat::TraceStopped, _timeSource.now(), nullptr, 0);
+        _trace.reset();
+    }
+}
+
+void StateMachine::traceText(CallTraceFormat::Call call, const char* text) {
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    if (_trace != nullptr) {
+        _trace->writeText(call, _timeSource.now(), text);
+    }
+}
+
+void StateMachine::traceNumbers(CallTraceFormat::Call call, const uint64_t* values, size_t count) {
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    if (_trace != nullptr) {
+        _trace->writeNumbers(call, _timeSource.now(), values, count);
+    }
+}
+
+void StateMachine::traceChannelText(uint32_t channel, CallTraceFormat::Call call, const char* text) {
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    if (_trace != nullptr) {
+        int64_t now = _timeSource.now();
+        if (channel != _tracedChannel) {
+            uint64_t value = channel;
+            _trace->writeNumbers(CallTraceFormat::SelectChannel, now, &value, 1);
+            _tracedChannel = channel;
+        }
+        _trace->writeText(call, now, text);
+    }
+}
+
+void StateMachine::traceChannelNumbers(uint32_t channel, CallTraceFormat::Call call, const uint64_t* values, size_t count) {
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    if (_trace != nullptr) {
+        int64_t now = _timeSource.now();
+        if (channel != _tracedChannel) {
+            uint64_t value = channel;
+            _trace->writeNumbers(CallTraceFormat::SelectChannel, now, &value, 1);
+            _tracedChannel = channel;
+        }
+        _trace->writeNumbers(call, now, values, count);
+    }
+}
+
+struct CommandBarrier {
+    std::mutex mutex;
+    std::condition_variable reached;
+    bool done = false;
+};
+
+void StateMachine::waitForPendingCommands() {
+    if (isExecutorThread()) { // virtual time runs commands on submit, or an export from inside a callback
+        return;
+    }
+    CommandBarrier barrier;
+    Command command;
+    command.type = Command::Barrier;
+    command.barrier = &barrier;
+    submit(command);
+    std::unique_lock<std::mutex> lock(barrier.mutex);
+    barrier.reached.wait(lock, [&barrier]{ return barrier.done; });
+}
+
+#pragma mark - Executor
+
+void StateMachine::runExecutor() {
+    while (drainCommands()) {
+        waitForCommands();
+    }
+}
+
+// Returns false once the shutdown command has been reached.
+bool StateMachine::drainCommands() {
+    _draining = true;
+    Command command;
+    while (_commands.pop(command)) {
+        if (command.type == Command::Shutdown) {
+            _draining = false;
+            return false;
+        }
+        _eventTimestamp = command.timestamp;
+        if (command.type != Command::TimerElapsed) { // timers are measured against their deadline instead
+            _timing[TimingMetric::CommandDispatchLag].record(_timeSource.now() - command.timestamp);
+        }
+        executeCommand(command);
+        delete[] command.heapText;
+        delete[] command.telemetryBatch;
+    }
+    _draining = false;
+    return true;
+}
+
+int64_t StateMachine::advanceClock(int64_t nanoseconds) {
+    if (!isVirtualTime()) {
+        return now();
+    }
+    _virtualTime->advanceTo(_virtualTime->now() + nanoseconds);
+    return _virtualTime->now();
+}
+
+int64_t StateMachine::advanceToNextDeadline() {
+    if (!isVirtualTime() || !_virtualTime->fireNext(_virtualTime->nextDeadline())) {
+        return -1;
+    }
+    return _virtualTime->now();
+}
+
+void StateMachine::waitForCommands() {
+    _executorSleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // a submitter that already cleared the flag posts, and that post is taken here rather than
+    // left to cut the next sleep short
+    if (!_commands.empty() && _executorSleeping.exchange(false)) {
+        return;
+    }
+    _wakeUp.wait();
+}
+
+void StateMachine::executeCommand(const Command& command) {
+    StimulusChannel& channel = *_channels[command.channel < _activeChannelCount ? command.channel : 0];
+    if (command.channel >= _activeChannelCount && command.type != Command::AddChannel) {
+        return; // not added yet, or not a channel of this session
+    }
+    switch (command.type) {
+        case Command::ProcessEvent:
+            for (uint32_t i = 0; i < _activeChannelCount; i++) {
+                processEvent(*_channels[i], command.eventId);
             }
+            break;
+        case Command::TimerElapsed: {
+            // the timer may have been stopped or re-armed after this was queued
+            bool isSignal = command.eventId == Event::SignalTimeElapsed;
+            Timer& timer = isSignal ? channel.signalTimeElapsedTimer : channel.responseTimeoutTimer;
+            if (timer.isCurrent(command.timerGeneration)) {
+                int64_t deadline = isSignal ? channel.nextStimulusDeadline.load(std::memory_order_relaxed) : channel.responseTimeoutDeadline;
+                _timing[isSignal ? TimingMetric::SignalTimerLateness : TimingMetric::ResponseTimerLateness].record(_timeSource.now() - deadline);
+                processEvent(channel, command.eventId);
+            }
+            break;
         }
+        case Command::Response:
+            // a response the state has no transition for is dropped, so its position can't end up on a later timeout
+            if (k_transitionTable.next[Event::ResponseReceived][channel.state] != k_invalidTransition) {
+                addPreviousPosition(channel, commandText(command));
+            }
+            processEvent(channel, Event::ResponseReceived);
+            break;
+        case Command::LogEvent:
+            addLogEvent(commandText(command));
+            break;
+        case Command::Telemetry:
+            addTelemetry(command.telemetryBatch != nullptr ? command.telemetryBatch : &command.telemetry, command.telemetryCount);
+            break;
+        case Command::Milestone:
+            addMilestone();
+            checkJournal();
+            break;
+        case Command::Reset:
+            resetState();
+            break;
+        case Command::SetCallbacks:
+            setDebugLogCallback(command.debugLogCallback);
+            channel.signalSendingCallback = command.signalSendingCallback;
+            channel.signalStopCallback = command.signalStopCallback;
+            break;
+        case Command::SetChannelCallbacks:
+            channel.signalSendingCallback = command.signalSendingCallback;
+            channel.signalStopCallback = command.signalStopCallback;
+            break;
+        case Command::SetJournal:
+            setJournal(command.journal);
+            break;
+        case Command::FlushJournal:
+            if (_journal != nullptr) {
+                _journal->flush();
+                checkJournal();
+            }
+            break;
+        case Command::SetSchedule:
+            channel.schedule.reset(command.schedule);
+            break;
+        case Command::SetResponseTimeout:
+            channel.responseTimeout = command.onset;
+            break;
+        case Command::SetSeed:
+            _seed = command.seed;
+            for (uint32_t i = 0; i < _activeChannelCount; i++) {
+                seedChannel(*_channels[i]);
+            }
+            break;
+        case Command::StimulusPresented:
+            setStimulusOnset(channel, command.onset);
+            break;
+        case Command::ResetTiming:
+            for (TimingHistogram& histogram : _timing) {
+                histogram.reset();
+            }
+            break;
+        case Command::AddChannel:
+            activateChannel(command.channel);
+            break;
+        case Command::Task:
+            command.task(*this, command.taskContext);
+            break;
+        case Command::Barrier: {
+            std::lock_guard<std::mutex> lock(command.barrier->mutex);
+            command.barrier->done = true;
+            command.barrier->reached.notify_one();
+            break;
+        }
+    }
+}
+
+// Channels are added in index order, so the command of the next one to activate always comes first.
+void StateMachine::activateChannel(uint32_t index) {
+    if (index != _activeChannelCount) {
+        return;
+    }
+    _activeChannelCount++;
+    StimulusChannel& channel = *_channels[index];
+    seedChannel(channel);
+    if (_measuring) {
+        processEvent(channel, Event::StartMeasure);
     }
-   // assert(validTransitionFound);
-    if (!validTransitionFound) {
-        debugLog("Reached Assert State with event %s", eventToString(eventId).c_str());
+}
+
+// Channel 0 draws from the session's seed as a single channel session always has.
+void StateMachine::seedChannel(StimulusChannel& channel) {
+    channel.random.seed(_seed ^ (channel.index * 0x9e3779b97f4a7c15ull));
+}
+
+void StateMachine::processEvent(StimulusChannel& channel, int eventId) {
+    // events raised by a transition are handled by this loop rather than by recursing
+    for (int event = eventId; event != k_noEvent; event = _chainedEvent) {
+        _chainedEvent = k_noEvent;
+        int nextState = k_transitionTable.next[event][channel.state];
+        if (nextState == k_invalidTransition) {
+            CallMetrics::countAssertState();
+            DEBUG_LOG(_log, LogLevel::Warning, "Reached Assert State with event %s", eventToString(event));
+            continue;
+        }
+        DEBUG_LOG(_log, LogLevel::Debug, "%s: %s -> %s", eventToString(event), stateToString(channel.state), stateToString(nextState));
+        Transition transition = {event, channel.state, nextState};
+        channel.state = nextState;
+        // timed on its own: an event it chains is the next iteration's transition
+        CallMetrics::Clock::time_point start = CallMetrics::Clock::now();
+        processTransition(channel, transition);
+        CallMetrics::recordTransition(event, transition.validState, std::chrono::duration_cast<std::chrono::nanoseconds>(CallMetrics::Clock::now() - start).count());
     }
 }
 
-void StateMachine::processTransition(const Transition& transition) {
+void StateMachine::processTransition(StimulusChannel& channel, const Transition& transition) {
     switch (transition.nextState) {
         case State::WaitForStart: {
-            debugLog("Reached WaitForStart State");
+            DEBUG_LOG(_log, LogLevel::Trace, "Reached WaitForStart State");
             break;
         }
         case State::Idle: {
-            debugLog("Reached Idle State");
-            if (transition.validState == State::WaitForStart) {
-                _startMeasuringTimestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+            DEBUG_LOG(_log, LogLevel::Trace, "Reached Idle State");
+            if (!_measuring) {
+                _measuring = true;
+                _startMeasuringTimestamp = _eventTimestamp;
             }
-            int randsecs = std::rand()%(k_maxSignalSeconds-k_minSignalSeconds + 1) + k_minSignalSeconds;
-            s_signalTimeElapsedTimer.start(std::chrono::milliseconds(randsecs * 1000), []{
-                    StateMachine::GetInstance().processEvent(Event::SignalTimeElapsed);
-                });
+            scheduleNextStimulus(channel);
             break;
         }
         case State::SendSignal: {
-            debugLog("Reached SendSignal State");
-            s_signalTimeElapsedTimer.stop();
-            if (_signalSendingCallback) {
-                (*_signalSendingCallback)();
+            DEBUG_LOG(_log, LogLevel::Trace, "Reached SendSignal State");
+            channel.signalTimeElapsedTimer.stop();
+            channel.nextStimulusDeadline.store(-1, std::memory_order_release);
+            // onset is taken before dispatch so the host's callback time is part of the reaction time
+            channel.sentSignalTimestamp = _timeSource.now();
+            if (channel.pollMode) {
+                // corrected by setStimulusOnset once the host reports the frame that showed it
+                channel.awaitingPresent = true;
+                channel.signalCallbackDuration = 0;
+                channel.stimulusVisible.store(true, std::memory_order_release);
+            } else {
+                if (channel.signalSendingCallback) {
+                    (*channel.signalSendingCallback)();
+                }
+                channel.signalCallbackDuration = _timeSource.now() - channel.sentSignalTimestamp;
+                _timing[TimingMetric::SignalDelivery].record(channel.signalCallbackDuration);
             }
-            _sentSignalTimestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-            processEvent(Event::SignalSent);
+            _chainedEvent = Event::SignalSent;
             break;
         }
         case State::WaitResponse: {
-            debugLog("Reached WaitResponse State");
-            s_responseTimeoutTimer.start(std::chrono::milliseconds(k_responseTimeoutSeconds * 1000), []{
-                    StateMachine::GetInstance().processEvent(Event::ResponseTimeout);
-                });
+            DEBUG_LOG(_log, LogLevel::Trace, "Reached WaitResponse State");
+            armResponseTimeout(channel, _timeSource.now());
             break;
         }
         case State::ProcessResponse: {
-            debugLog("Reached Process Response State");
-            s_responseTimeoutTimer.stop();
-            long now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-            long msSinceStart = now - _startMeasuringTimestamp.count();
-            long msReactionTime = now - _sentSignalTimestamp.count();
-            if (msReactionTime < 100) { // if reaction time is lower then the limit of human reaction time then we record it the same as having missed the stimulus
-                msReactionTime = k_responseTimeoutSeconds * 1000;
+            DEBUG_LOG(_log, LogLevel::Trace, "Reached Process Response State");
+            channel.responseTimeoutTimer.stop();
+            int64_t now = _eventTimestamp; // when the response arrived or the timeout fired
+            int64_t usSinceStart = (now - _startMeasuringTimestamp) / 1000;
+            int64_t usReactionTime = (now - channel.sentSignalTimestamp) / 1000;
+            bool timedOut = transition.eventId == Event::ResponseTimeout;
+            bool falseStart = !timedOut && usReactionTime < k_minHumanReactionMicroseconds;
+            uint32_t outcome = timedOut ? ReactionOutcome::Timeout : falseStart ? ReactionOutcome::FalseStart : ReactionOutcome::Response;
+            if (usReactionTime < k_minHumanReactionMicroseconds) { // if reaction time is lower then the limit of human reaction time then we record it the same as having missed the stimulus
+                usReactionTime = k_missedReactionMicroseconds;
             }
-            if (_signalStopCallback) {
-                (*_signalStopCallback)();
+            channel.awaitingPresent = false;
+            if (channel.pollMode) {
+                channel.stimulusVisible.store(false, std::memory_order_release);
+            } else if (channel.signalStopCallback) {
+                (*channel.signalStopCallback)();
             }
+            int64_t usCallbackDuration = channel.signalCallbackDuration / 1000;
             if (_shouldAddMilestone) {
-                debugLog("MileStone Added");
+                DEBUG_LOG(_log, LogLevel::Info, "MileStone Added");
                 _shouldAddMilestone = false;
-                std::map<long,std::pair<long, std::string>> m;
-                std::pair<long, std::string> p{ msReactionTime, _previousPosition };
-                m[msSinceStart] = p;
-                _collectedData.first.emplace_back(m);
-            } else {
-                std::pair<long, std::string> p{ msReactionTime, _previousPosition };
-                _collectedData.first.back().emplace(msSinceStart, p);
+                _reactionMilestoneCount++;
             }
-            debugLog("ms from start: %d, ms reaction:%d", msSinceStart, msReactionTime);
-            _previousPosition = "";
-            processEvent(Event::ResponseProcessed);
+            _store.appendReaction(usSinceStart, usReactionTime, usCallbackDuration, _reactionMilestoneCount - 1, channel.previousPositionId, channel.index,
+                                outcome);
+            addReactionStats(_reactionMilestoneCount - 1, usReactionTime, outcome);
+            DEBUG_LOG(_log, LogLevel::Debug, "us from start: %lld, us reaction: %lld, us callback: %lld", (long long)usSinceStart, (long long)usReactionTime, (long long)usCallbackDuration);
+            channel.previousPositionId = SessionStore::k_noPosition;
+            _chainedEvent = Event::ResponseProcessed;
             break;
         }
     }
 }
 
+void StateMachine::scheduleNextStimulus(StimulusChannel& channel) {
+    int64_t deadline = _timeSource.now() + channel.schedule->nextInterval(channel.random);
+    channel.nextStimulusDeadline.store(deadline, std::memory_order_release);
+    uint32_t index = channel.index;
+    channel.signalTimeElapsedTimer.startAt(deadline, [this, index](uint32_t generation){
+            return submitTimerEvent(Event::SignalTimeElapsed, index, generation);
+        });
+}
+
+void StateMachine::armResponseTimeout(StimulusChannel& channel, int64_t onset) {
+    channel.responseTimeoutDeadline = onset + channel.responseTimeout;
+    uint32_t index = channel.index;
+    channel.responseTimeoutTimer.startAt(channel.responseTimeoutDeadline, [this, index](uint32_t generation){
+            return submitTimerEvent(Event::ResponseTimeout, index, generation);
+        });
+}
+
+// Poll mode: the stimulus reached the screen at onset. Reaction time and the response timeout
+// count from there, and the delay since it was raised is recorded as the callback duration.
+void StateMachine::setStimulusOnset(StimulusChannel& channel, int64_t onset) {
+    if (!channel.awaitingPresent || channel.state != State::WaitResponse) {
+        return; // already answered, timed out or reset
+    }
+    channel.awaitingPresent = false;
+    if (onset < channel.sentSignalTimestamp) {
+        onset = channel.sentSignalTimestamp;
+    }
+    channel.signalCallbackDuration = onset - channel.sentSignalTimestamp;
+    _timing[TimingMetric::SignalDelivery].record(channel.signalCallbackDuration);
+    channel.sentSignalTimestamp = onset;
+    armResponseTimeout(channel, onset);
+}
+
+void StateMachine::addReactionStats(uint32_t milestone, int64_t reactionTime, uint32_t outcome) {
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    addReactionStatsLocked(milestone, reactionTime, outcome);
+}
+
+void StateMachine::addReactionStatsLocked(uint32_t milestone, int64_t reactionTime, uint32_t outcome) {
+    if (_milestoneStats.size() <= milestone) {
+        _milestoneStats.resize(milestone + 1);
+    }
+    ReactionStats& stats = _milestoneStats[milestone];
+    if (outcome == ReactionOutcome::Timeout) {
+        stats.timeouts++;
+    } else if (outcome == ReactionOutcome::FalseStart) {
+        stats.falseStarts++;
+    } else {
+        stats.addResponse(static_cast<double>(reactionTime));
+    }
+}
+
+bool StateMachine::milestoneStats(uint32_t index, ReactionStats& stats) const {
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    if (index >= _milestoneStats.size()) {
+        return false;
+    }
+    stats = _milestoneStats[index];
+    return true;
+}
+
+bool StateMachine::restoreFromJournal(const char* path) {
+    if (!SessionJournal::recover(path, _store)) {
+        return false;
+    }
+    SessionStore::Snapshot snapshot = _store.snapshot(0, SIZE_MAX);
+    uint32_t channels = 1;
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    _milestoneStats.clear();
+    for (size_t i = snapshot.reactions.begin(); i < snapshot.reactions.end(); i++) {
+        const ReactionChunk& chunk = snapshot.reactions.chunk(i);
+        size_t slot = snapshot.reactions.slot(i);
+        uint32_t milestone = chunk.milestone[slot];
+        channels = std::max(channels, static_cast<uint32_t>(chunk.channel[slot]) + 1);
+        addReactionStatsLocked(milestone, chunk.reactionTime[slot], chunk.outcome[slot]);
+    }
+    // the channels the reactions came from, so the exports keep their channel column
+    while (channelCount() < channels && addChannel() >= 0) {
+    }
+    return true;
+}
+
+void StateMachine::setJournal(SessionJournal* journal) {
+    _store.setJournal(nullptr);
+    _journal.reset(journal);
+    _journalFailed = false;
+    if (_journal != nullptr) {
+        _store.setJournal(_journal.get());
+        checkJournal();
+    }
+}
+
+// Reports a journal that stopped writing, once.
+void StateMachine::checkJournal() {
+    if (_journal != nullptr && _journal->hasFailed() && !_journalFailed.exchange(true)) {
+        DEBUG_LOG(_log, LogLevel::Error, "JOURNAL: writing to disk failed, nothing recorded from here on is journaled");
+    }
+}
+
 // StopMeasure
 void StateMachine::resetState() {
-    s_signalTimeElapsedTimer.stop();
-    s_responseTimeoutTimer.stop();
-    debugLog("RESET: %s -> %s", stateToString(_state).c_str(), stateToString(_initialState).c_str());
-    _state = _initialState;
+    for (uint32_t i = 0; i < _activeChannelCount; i++) {
+        StimulusChannel& channel = *_channels[i];
+        channel.signalTimeElapsedTimer.stop();
+        channel.responseTimeoutTimer.stop();
+        channel.nextStimulusDeadline.store(-1, std::memory_order_release);
+        channel.stimulusVisible.store(false, std::memory_order_release);
+        channel.awaitingPresent = false;
+        DEBUG_LOG(_log, LogLevel::Info, "RESET: %s -> %s", stateToString(channel.state), stateToString(_initialState));
+        channel.state = _initialState;
+        channel.previousPositionId = SessionStore::k_noPosition; // ids don't survive the clear
+        channel.signalStopCallback = nullptr;
+        channel.signalSendingCallback = nullptr;
+    }
+    _measuring = false;
     _shouldAddMilestone = true; // Start at true to create first milestone
     _shouldAddLogMilestone = true;
-    _collectedData.first.clear();
-    _collectedData.second.clear();
-    _signalStopCallback = nullptr;
-    _signalSendingCallback = nullptr;
+    _reactionMilestoneCount = 0;
+    _eventMilestoneCount = 0;
+    _store.clear();
+    {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _milestoneStats.clear();
+    }
 }
 
 // MileStone Reached
@@ -242,75 +999,35 @@ void StateMachine::addMilestone() {
     _shouldAddLogMilestone = true;
 }
 
-void StateMachine::setSignalSendingCallback(void (*callback)()) {
-    _signalSendingCallback = callback;
+void StateMachine::addLogEvent(const char* eventName) {
+    if (!openEventMilestone()) {
+        return;
+    }
+    int64_t usSinceStart = (_eventTimestamp - _startMeasuringTimestamp) / 1000;
+    _store.appendEvent(usSinceStart, _eventMilestoneCount - 1, eventName);
 }
 
-void StateMachine::setSignalStopCallback(void (*callback)()) {
-    _signalStopCallback = callback;
+void StateMachine::addTelemetry(const TelemetrySample* samples, size_t count) {
+    if (!openEventMilestone()) {
+        return;
+    }
+    int64_t usSinceStart = (_eventTimestamp - _startMeasuringTimestamp) / 1000;
+    _store.appendTelemetry(usSinceStart, _eventMilestoneCount - 1, samples, count);
 }
 
-void StateMachine::addLogEvent(std::string eventName) {
-    if (_state == State::WaitForStart) {
-        return;
+// Events and telemetry share the milestone groups. False until the measurement has started.
+bool StateMachine::openEventMilestone() {
+    if (!_measuring) {
+        return false;
     }
-    
-    long now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    long msSinceStart = now - _startMeasuringTimestamp.count();
     if (_shouldAddLogMilestone) {
-        debugLog("MileStone Added");
+        DEBUG_LOG(_log, LogLevel::Info, "MileStone Added");
         _shouldAddLogMilestone = false;
-        std::map<long,std::string> m;
-        m[msSinceStart] = eventName;
-        _collectedData.second.emplace_back(m);
-    } else {
-        _collectedData.second.back().emplace(msSinceStart, eventName);
+        _eventMilestoneCount++;
     }
+    return true;
 }
 
 void StateMachine::setDebugLogCallback(void (*callback)(const char *)) {
-    _debugLogCallback = callback;
-}
-
-void StateMachine::debugLog(const char* str, ...) {
-    if (_debugLogCallback != nullptr && !(str == nullptr || std::strlen(str) == 0)) {
-        va_list args;
-        va_start(args, str);
-        
-        va_list argsCopy;
-        va_copy(argsCopy, args);
-
-        auto bufferSize = vsnprintf(nullptr, 0, str, args);
-
-        if (bufferSize <= 0) {
-            va_end(argsCopy);
-            va_end(args);
-            return;
-        }
-        
-        char* buffer = (char*)malloc((size_t)bufferSize + 1); // + 1 for string delimiter
-#ifndef MAC_BUILD
-        auto writtenBytes = vsprintf_s(buffer, (size_t)bufferSize + 1, str, argsCopy);
-#else
-        auto writtenBytes = vsprintf(buffer, str, argsCopy);
-#endif
-        
-        if (writtenBytes != bufferSize) {
-            free(buffer);
-            buffer = nullptr;
-            
-            va_end(argsCopy);
-            va_end(args);
-            return;
-        }
-        
-        std::string result(buffer);
-        
-        free(buffer);
-        buffer = nullptr;
-        
-        (*_debugLogCallback)(result.c_str());
-        va_end(argsCopy);
-        va_end(args);
-    }
+    _log.setCallback(callback);
 }
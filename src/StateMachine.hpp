@@ -8,18 +8,36 @@
 #ifndef StateMachine_hpp
 #define StateMachine_hpp
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "CallTrace.hpp"
+#include "CommandQueue.hpp"
+#include "DebugLog.hpp"
+#include "ReactionStats.hpp"
+#include "Semaphore.hpp"
+#include "SessionJournal.hpp"
+#include "SessionStore.hpp"
+#include "StimulusSchedule.hpp"
+#include "TimerScheduler.hpp"
+#include "TimingHistogram.hpp"
+#include "VirtualTimeSource.hpp"
+
 struct State {
     enum {
         WaitForStart,
         Idle,
         SendSignal,
         WaitResponse,
-        ProcessResponse
+        ProcessResponse,
+        Count
     };
 };
 
@@ -30,22 +48,120 @@ struct Event {
         SignalSent,
         ResponseReceived,
         ResponseTimeout,
-        ResponseProcessed
+        ResponseProcessed,
+        Count
+    };
+};
+
+// What the session's timing histograms measure, all in nanoseconds.
+struct TimingMetric {
+    enum {
+        SignalTimerLateness,    // stimulus due -> its transition executing
+        ResponseTimerLateness,  // response timeout due -> its transition executing
+        SignalDelivery,         // signal callback duration, poll mode: raised -> presented
+        CommandDispatchLag,     // host API call -> its command executing
+        Count
+    };
+};
+
+class StateMachine;
+
+// Work item handed from the public API and the timers to the session's executor thread.
+// Timestamps are taken by the caller so queueing delay never shows up in the data.
+struct Command {
+    enum {
+        ProcessEvent,
+        TimerElapsed,
+        Response,
+        LogEvent,
+        Telemetry,
+        Milestone,
+        Reset,
+        SetCallbacks,
+        SetJournal,
+        FlushJournal,
+        SetSchedule,
+        SetSeed,
+        StimulusPresented,
+        ResetTiming,
+        AddChannel,
+        SetChannelCallbacks,
+        SetResponseTimeout,
+        Task,
+        Barrier,
+        Shutdown
     };
+
+    static const size_t k_inlineTextCapacity = 48;
+
+    int type = Shutdown;
+    int eventId = 0;
+    uint32_t channel = 0;       // stimulus channel of responses, timers and channel settings
+    uint32_t timerGeneration = 0;
+    int64_t timestamp = 0;      // session time source nanoseconds
+    void (*signalSendingCallback)() = nullptr;
+    void (*signalStopCallback)() = nullptr;
+    void (*debugLogCallback)(const char *) = nullptr;
+    union {
+        char text[k_inlineTextCapacity];
+        TelemetrySample telemetry;      // a single Telemetry sample
+    };
+    char* heapText = nullptr;   // only for payloads that don't fit inline
+    TelemetrySample* telemetryBatch = nullptr;  // Telemetry batches, owned like heapText
+    size_t telemetryCount = 0;
+    struct CommandBarrier* barrier = nullptr;
+    SessionJournal* journal = nullptr;  // ownership passes to the executor
+    StimulusSchedule* schedule = nullptr;   // likewise
+    uint64_t seed = 0;
+    int64_t onset = 0;          // session time source nanoseconds; also the response timeout
+    void (*task)(StateMachine& stateMachine, void* context) = nullptr;
+    void* taskContext = nullptr;
+};
+
+// One stimulus stream of a session, with its own state, schedule, response timeout and
+// callbacks. All channels of a session run on its executor and their timers are slots on
+// the session's time source, so a channel costs memory but no thread.
+struct StimulusChannel {
+    StimulusChannel(TimeSource& timeSource, uint32_t index);
+
+    const uint32_t index;
+    int state;
+    bool awaitingPresent;       // poll mode: the onset is still the time the stimulus was raised
+    void (*signalSendingCallback)();
+    void (*signalStopCallback)();
+
+    FastRandom random;
+    std::unique_ptr<StimulusSchedule> schedule;
+    int64_t responseTimeout;    // nanoseconds
+    Timer signalTimeElapsedTimer;
+    Timer responseTimeoutTimer;
+
+    std::atomic<int64_t> nextStimulusDeadline;  // time source nanoseconds, -1 while no stimulus is armed
+    std::atomic<bool> pollMode;
+    std::atomic<bool> stimulusVisible;          // poll mode: what pollStimulus answers
+
+    // time source nanoseconds
+    int64_t sentSignalTimestamp;
+    int64_t signalCallbackDuration;
+    int64_t responseTimeoutDeadline;
+    uint32_t previousPositionId;
 };
 
 class StateMachine {
 public:
     struct Transition {
-        const int eventId;
-        const int validState;
-        const int nextState;
-        
-        Transition(int _eventId, int _validState, int _nextState) :
-            eventId(_eventId), validState(_validState), nextState(_nextState) {}
+        int eventId;
+        int validState;
+        int nextState;
     };
     
+    // Default session used by the legacy entry points; additional sessions are created with new/delete.
     static StateMachine& GetInstance();
+
+    // A virtual time session has no executor thread: commands run on the submitting
+    // thread and its clock only moves through advanceClock/advanceToNextDeadline.
+    explicit StateMachine(bool virtualTime = false);
+    ~StateMachine();
     
     // delete copy and move constructors and assign operators
     StateMachine(StateMachine const&) = delete;             // Copy construct
@@ -54,46 +170,216 @@ public:
     StateMachine& operator=(StateMachine &&) = delete;      // Move assign
     
     
-    bool checkState(int validState);
-    void processEvent(int eventId);
+    // Channel 0 always exists, the legacy single stimulus stream. More are added with addChannel.
+    static const uint32_t k_maxChannels = 8;
+
+    // Thread safe, lock free entry points. Each one enqueues a command for the executor thread
+    // and never waits for it: while the queue is full (the executor stalled, say in a slow host
+    // callback) the call is dropped and counted in droppedCalls. Events other than StartMeasure
+    // go to every channel.
+    void submitEvent(int eventId);
+    void submitResponse(const char* position, uint32_t channel = 0);
+    void submitLogEvent(const char* eventName);
+    // Copies the samples; a batch costs one allocation however many it holds. All of them
+    // are stamped with the time of the call.
+    void submitTelemetry(const TelemetrySample* samples, size_t count);
+    void submitMilestone();
+    void submitReset();
+    // Channel 0's stimulus callbacks and the session's debug log callback.
+    void submitCallbacks(void (*signalSendingCallback)(), void (*signalStopCallback)(), void (*debugLogCallback)(const char *));
+    void submitChannelCallbacks(uint32_t channel, void (*signalSendingCallback)(), void (*signalStopCallback)());
+    // Replaces the session's journal; null turns journaling off. Waits for room in the queue.
+    void submitJournal(std::unique_ptr<SessionJournal> journal);
+    // Returns once everything recorded before the call is on disk; false if the journal failed
+    // to write or sync since it was enabled.
+    bool flushJournal();
+
+    // Replaces how the wait before each stimulus is drawn, from the next wait on.
+    void submitSchedule(const StimulusSchedule& schedule, uint32_t channel = 0);
+    // How long a stimulus waits for its response, from the next stimulus on.
+    void submitResponseTimeout(int64_t timeout, uint32_t channel = 0);
+    // Restarts the random sequence of every channel; the same seed gives the same waits.
+    // Channel 0 draws from the seed itself, the others from seeds derived from it.
+    void submitSeed(uint64_t seed);
+    // Nanoseconds until the armed stimulus is due (0 if overdue), -1 while none is armed.
+    // Lets the host pre-stage the stimulus and line its onset up with a frame. Any thread.
+    int64_t peekNextStimulusTime(uint32_t channel = 0);
+
+    // Any thread. New channel with the default schedule and timeout, started right away if the
+    // measurement is running. Returns its index, or -1 once the session has k_maxChannels.
+    // Waits for room in the queue.
+    int addChannel();
+    uint32_t channelCount() const { return _channelCount.load(std::memory_order_acquire); }
+    bool hasChannel(uint32_t channel) const { return channel < channelCount(); }
+
+    // Poll mode replaces the stimulus callbacks: the host asks every frame whether the stimulus
+    // is to be shown and reports when it actually reached the screen, which then counts as the onset.
+    void setPollMode(bool enabled, uint32_t channel = 0) { _channels[channel]->pollMode = enabled; }
+    bool isPollMode(uint32_t channel = 0) const { return _channels[channel]->pollMode; }
+    // frameTimestamp is on the host's own clock, in nanoseconds; it relates that clock to the
+    // session's for submitStimulusPresented. Any thread, lock free.
+    bool pollStimulus(int64_t frameTimestamp, uint32_t channel = 0);
+    void submitStimulusPresented(int64_t presentTimestamp, uint32_t channel = 0);
+
+    // Any thread. Histograms are kept for the lifetime of the session unless reset.
+    void timingSnapshot(int metric, TimingHistogram::Snapshot& snapshot) const { _timing[metric].snapshot(snapshot); }
+    void submitTimingReset();
+
+    // Host calls dropped because the queue was full, since the session was created. Any thread.
+    uint64_t droppedCalls() const { return _droppedCalls.load(std::memory_order_relaxed); }
+
+    // Runs task on the executor once every command submitted before it has been executed,
+    // without waiting for it to run, but waiting for room in the queue. Virtual time sessions
+    // run it right away.
+    void submitTask(void (*task)(StateMachine& stateMachine, void* context), void* context);
+
+    // Opt-in record of the host's calls, see CallTrace.hpp. The entry points trace each call
+    // before submitting it. A trace opens with the session's seed, channels, schedules and
+    // response timeouts as the calls before it left them, so a replay starts from the same
+    // settings; the session itself is left as it is. Tracing calls lock, the check doesn't.
+    bool startTrace(const char* path);
+    void stopTrace();
+    bool isTracing() const { return _tracing.load(std::memory_order_relaxed); }
+    void traceText(CallTraceFormat::Call call, const char* text);
+    void traceNumbers(CallTraceFormat::Call call, const uint64_t* values, size_t count);
+    // Calls on one channel, preceded by a SelectChannel record whenever the channel changes.
+    void traceChannelText(uint32_t channel, CallTraceFormat::Call call, const char* text);
+    void traceChannelNumbers(uint32_t channel, CallTraceFormat::Call call, const uint64_t* values, size_t count);
+
+    // Before the session is started only: replaces the stored data with what the journal at path holds.
+    bool restoreFromJournal(const char* path);
+
+    // Any thread, constant time. Figures of the responses processed so far in milestone group
+    // index (as numbered in the exports), over all channels; false if the group hasn't been opened yet.
+    bool milestoneStats(uint32_t index, ReactionStats& stats) const;
+
+    // When enabled exports report microseconds and the callback duration, otherwise whole milliseconds.
+    void setHighResolutionTiming(bool enabled) { _highResolutionTiming = enabled; }
+    bool isHighResolutionTiming() const { return _highResolutionTiming; }
+
+    // When enabled reaction exports carry position ids, resolved through exportPositionDictionary.
+    void setExportPositionIds(bool enabled) { _exportPositionIds = enabled; }
+    bool isExportingPositionIds() const { return _exportPositionIds; }
+
+    // Messages above level are neither recorded nor delivered, see LogLevel.
+    void setLogLevel(int level) { _log.setLevel(level); }
+    // Delivers the debug messages of every command submitted so far to the callback, on the calling thread.
+    size_t drainDebugLog() {
+        waitForPendingCommands();
+        return _log.drain();
+    }
+
+    // Blocks until every command submitted before the call has been executed.
+    void waitForPendingCommands();
+
+    bool isVirtualTime() const { return _virtualTime != nullptr; }
+    int64_t now() { return _timeSource.now(); }
+    // Virtual time only: fire every timeout due in the next nanoseconds, or just the next one.
+    // Both return the new session time, advanceToNextDeadline returns -1 if nothing is pending.
+    int64_t advanceClock(int64_t nanoseconds);
+    int64_t advanceToNextDeadline();
+
+    // Reaction times, offsets and callback durations are stored in microseconds.
+    const SessionStore& store() const { return _store; }
+    
+private:
+    // Everything below runs on the executor thread only.
+    void processEvent(StimulusChannel& channel, int eventId);
     
     void resetState();
     void addMilestone();
     
-    void setSignalSendingCallback(void (*callback)());
-    void setSignalStopCallback(void (*callback)());
     void setDebugLogCallback(void (*callback)(const char *));
+    void activateChannel(uint32_t index);
     
-    void addLogEvent(std::string eventName);
+    void addLogEvent(const char* eventName);
+    void addTelemetry(const TelemetrySample* samples, size_t count);
+    bool openEventMilestone();
+    void setJournal(SessionJournal* journal);
+    void checkJournal();
+    void scheduleNextStimulus(StimulusChannel& channel);
+    void armResponseTimeout(StimulusChannel& channel, int64_t onset);
+    void setStimulusOnset(StimulusChannel& channel, int64_t onset);
+    void addReactionStats(uint32_t milestone, int64_t reactionTime, uint32_t outcome);
+    void addReactionStatsLocked(uint32_t milestone, int64_t reactionTime, uint32_t outcome);
+    void seedChannel(StimulusChannel& channel);
+
+    // A record startTrace opens the trace with.
+    struct TracedCall {
+        CallTraceFormat::Call call;
+        std::vector<uint64_t> values;
+    };
+    void captureTraceStart(std::vector<TracedCall>& calls) const;
+
+    void addPreviousPosition(StimulusChannel& channel, const char* prevPos) { channel.previousPositionId = _store.internPosition(prevPos); };
+
+    // Commands run on the calling thread: a virtual session, or the executor itself.
+    bool isExecutorThread() const { return isVirtualTime() || std::this_thread::get_id() == _executor.get_id(); }
+    void submit(Command& command);
+    bool trySubmit(Command& command);
+    void submitHostCall(Command& command);
+    void wakeExecutor();
+    bool submitTimerEvent(int eventId, uint32_t channel, uint32_t generation);
+    void runExecutor();
+    bool drainCommands();
+    void executeCommand(const Command& command);
+    void waitForCommands();
 
-    void addPreviousPosition(std::string prevPos) { _previousPosition = prevPos; };
-    
-    std::pair<std::vector<std::map<long, std::pair<long, std::string>>>, std::vector<std::map<long,std::string>>> getCollectedData() {return _collectedData;};
-    
-protected:
-    StateMachine();
-    ~StateMachine(){}
-    
 private:
-    void setValidTransitions(std::vector<Transition> validTransitions);
-    void processTransition(const Transition& transition);
-    void debugLog(const char *, ...);
+    void processTransition(StimulusChannel& channel, const Transition& transition);
     
 private:
-    std::map<int, std::vector<Transition>> _validTransitions;
-    
     int _initialState;
-    int _state;
+    int _chainedEvent;          // internal follow-up event raised by processTransition
+    bool _measuring;            // between StartMeasure and the reset that stops it
     bool _shouldAddMilestone;
     bool _shouldAddLogMilestone;
-    void (*_signalSendingCallback)();
-    void (*_signalStopCallback)();
-    void (*_debugLogCallback)(const char *);
-    
-    std::chrono::milliseconds _startMeasuringTimestamp;
-    std::chrono::milliseconds _sentSignalTimestamp;
-    std::string _previousPosition;
-    std::pair<std::vector<std::map<long, std::pair<long, std::string>>>, std::vector<std::map<long,std::string>>> _collectedData;
+    DebugLog _log;
+
+    uint64_t _seed;             // the channels' random sequences derive from it
+    std::unique_ptr<VirtualTimeSource> _virtualTime;
+    TimeSource& _timeSource;
+
+    // Created under _channelMutex, then published by _channelCount; never removed before the session.
+    std::unique_ptr<StimulusChannel> _channels[k_maxChannels];
+    std::atomic<uint32_t> _channelCount;
+    std::mutex _channelMutex;
+    uint32_t _activeChannelCount;   // executor: channels whose AddChannel command has run
+
+    std::atomic<bool> _highResolutionTiming;
+    std::atomic<bool> _exportPositionIds;
+    // Session time minus host time as each of the last polls saw it, INT64_MAX while unused.
+    // A poll runs some time after its frame's timestamp, never before, so the smallest is the
+    // closest to the true offset; the window follows any drift between the clocks.
+    static const uint32_t k_hostClockWindow = 64;
+    std::atomic<int64_t> _hostClockOffsets[k_hostClockWindow];
+    std::atomic<uint32_t> _hostClockPolls;
+
+    // time source nanoseconds
+    int64_t _eventTimestamp;    // taken when the command being executed was submitted
+    int64_t _startMeasuringTimestamp;
+
+    // number of milestone groups opened so far in the reaction and event logs
+    uint32_t _reactionMilestoneCount;
+    uint32_t _eventMilestoneCount;
+    SessionStore _store;
+    std::unique_ptr<SessionJournal> _journal;
+    std::atomic<bool> _journalFailed;   // the journal failed and it was reported
+    std::vector<ReactionStats> _milestoneStats;     // per reaction milestone group
+    mutable std::mutex _statsMutex;                 // executor writes, readers copy one entry out
+    TimingHistogram _timing[TimingMetric::Count];
+
+    std::atomic<bool> _tracing;
+    std::mutex _traceMutex;     // serialises the API threads writing to the trace
+    std::unique_ptr<CallTrace> _trace;
+    uint32_t _tracedChannel;    // channel of the last SelectChannel record, under _traceMutex
+
+    CommandQueue<Command, 1024> _commands;
+    bool _draining;             // virtual time: a command is executing further up the stack
+    std::atomic<bool> _executorSleeping;
+    Semaphore _wakeUp;          // posted by whoever clears _executorSleeping
+    std::atomic<uint64_t> _droppedCalls;
+    std::thread _executor;
 };
 
 #endif /* StateMachine_hpp */
@@ -0,0 +1,109 @@
+//
+//  StimulusSchedule.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "StimulusSchedule.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#pragma mark - Fast Random
+
+static uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+void FastRandom::seed(uint64_t seed) {
+    for (uint64_t& word : _state) {
+        word = splitMix64(seed);
+    }
+}
+
+uint64_t FastRandom::next() {
+    uint64_t result = rotateLeft(_state[1] * 5, 7) * 9;
+    uint64_t t = _state[1] << 17;
+    _state[2] ^= _state[0];
+    _state[3] ^= _state[1];
+    _state[1] ^= _state[2];
+    _state[0] ^= _state[3];
+    _state[2] ^= t;
+    _state[3] = rotateLeft(_state[3], 45);
+    return result;
+}
+
+int64_t FastRandom::nextInRange(int64_t low, int64_t high) {
+    uint64_t span = static_cast<uint64_t>(high - low) + 1;
+    if (span == 0) {
+        return static_cast<int64_t>(next());
+    }
+    // reject the top sliver that would bias the modulo
+    uint64_t limit = UINT64_MAX - UINT64_MAX % span;
+    uint64_t value;
+    do {
+        value = next();
+    } while (value >= limit);
+    return low + static_cast<int64_t>(value % span);
+}
+
+#pragma mark - Stimulus Schedule
+
+StimulusSchedule StimulusSchedule::uniform(int64_t minimum, int64_t maximum) {
+    StimulusSchedule schedule;
+    schedule._kind = Uniform;
+    schedule._minimum = std::min(minimum, maximum);
+    schedule._maximum = std::max(minimum, maximum);
+    return schedule;
+}
+
+StimulusSchedule StimulusSchedule::exponential(int64_t minimum, int64_t mean, int64_t maximum) {
+    StimulusSchedule schedule;
+    schedule._kind = Exponential;
+    schedule._minimum = minimum;
+    schedule._maximum = std::max(minimum, maximum);
+    schedule._mean = static_cast<double>(std::max<int64_t>(mean - minimum, 1));
+    return schedule;
+}
+
+StimulusSchedule StimulusSchedule::list(const int64_t* intervals, size_t count) {
+    StimulusSchedule schedule;
+    schedule._kind = List;
+    schedule._intervals.assign(intervals, intervals + count);
+    return schedule;
+}
+
+std::vector<int64_t> StimulusSchedule::upcomingIntervals() const {
+    std::vector<int64_t> intervals(_intervals.begin() + _nextIndex, _intervals.end());
+    intervals.insert(intervals.end(), _intervals.begin(), _intervals.begin() + _nextIndex);
+    return intervals;
+}
+
+int64_t StimulusSchedule::nextInterval(FastRandom& random) {
+    switch (_kind) {
+        case Uniform:
+            return random.nextInRange(_minimum, _maximum);
+        case Exponential: {
+            // inverse CDF of the exponential truncated to [0, maximum - minimum]
+            double range = static_cast<double>(_maximum - _minimum);
+            double u = random.nextDouble() * (1.0 - std::exp(-range / _mean));
+            double wait = -_mean * std::log1p(-u);
+            return _minimum + static_cast<int64_t>(std::min(wait, range));
+        }
+        case List: {
+            if (_intervals.empty()) {
+                return 0;
+            }
+            int64_t interval = _intervals[_nextIndex];
+            _nextIndex = (_nextIndex + 1) % _intervals.size();
+            return interval;
+        }
+    }
+    return _minimum;
+}
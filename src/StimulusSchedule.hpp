@@ -0,0 +1,66 @@
+//
+//  StimulusSchedule.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef StimulusSchedule_hpp
+#define StimulusSchedule_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// xoshiro256** seeded through splitmix64. A few shifts and multiplies per draw
+// and a state that belongs to one session, so sessions never share a sequence.
+class FastRandom {
+public:
+    explicit FastRandom(uint64_t seed = 0) { this->seed(seed); }
+
+    void seed(uint64_t seed);
+    uint64_t next();
+    // Uniform in [0, 1).
+    double nextDouble() { return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0); }
+    // Uniform in [low, high].
+    int64_t nextInRange(int64_t low, int64_t high);
+
+private:
+    uint64_t _state[4];
+};
+
+// Draws the interval between the end of one trial and the next stimulus.
+class StimulusSchedule {
+public:
+    enum Kind {
+        Uniform,        // every interval in [min, max] equally likely
+        Exponential,    // min plus an exponential wait truncated at max: a flat hazard, so onsets can't be anticipated
+        List            // preloaded intervals in order, starting over after the last one
+    };
+
+    // Uniform over [minimum, maximum], nanoseconds.
+    static StimulusSchedule uniform(int64_t minimum, int64_t maximum);
+    // Mean is the mean of the untruncated distribution, min < mean.
+    static StimulusSchedule exponential(int64_t minimum, int64_t mean, int64_t maximum);
+    static StimulusSchedule list(const int64_t* intervals, size_t count);
+
+    Kind kind() const { return _kind; }
+    int64_t nextInterval(FastRandom& random);
+
+    // The parameters as set, nanoseconds; mean is the exponential's untruncated mean.
+    int64_t minimum() const { return _minimum; }
+    int64_t maximum() const { return _maximum; }
+    int64_t mean() const { return _minimum + static_cast<int64_t>(_mean); }
+    // List intervals in the order they will be drawn, from the next one on.
+    std::vector<int64_t> upcomingIntervals() const;
+
+private:
+    StimulusSchedule() {}
+
+    Kind _kind = Uniform;
+    int64_t _minimum = 0;
+    int64_t _maximum = 0;
+    double _mean = 0;               // exponential part, beyond the minimum
+    std::vector<int64_t> _intervals;
+    size_t _nextIndex = 0;
+};
+
+#endif /* StimulusSchedule_hpp */
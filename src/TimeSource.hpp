@@ -0,0 +1,77 @@
+//
+//  TimeSource.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef TimeSource_hpp
+#define TimeSource_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// Clock plus timer slots used by a session. Times are nanoseconds on a
+// monotonic time base; the real implementation is TimerScheduler and the
+// simulated one is VirtualTimeSource.
+class TimeSource {
+public:
+    // Receives the generation it was armed with, see isCurrent(). Returns false if it couldn't
+    // hand its work over without waiting; the real time scheduler then runs it again shortly.
+    typedef std::function<bool(uint32_t)> Timeout;
+
+    struct Handle {
+        uint32_t slot;
+        uint32_t generation;
+    };
+
+    virtual ~TimeSource() {}
+
+    virtual int64_t now() = 0;
+
+    virtual uint32_t allocateSlot() = 0;
+    virtual void releaseSlot(uint32_t slot) = 0;
+
+    // Arms the slot, replacing whatever was pending on it.
+    virtual Handle arm(uint32_t slot, int64_t deadline, const Timeout& timeout) = 0;
+    // Once cancel returns the slot's pending timeout is guaranteed not to run.
+    virtual void cancel(uint32_t slot) = 0;
+    // True until the slot is cancelled or re-armed, including after the timeout fired.
+    // Lets consumers that defer a timeout's work discard it if the timer was stopped meanwhile.
+    virtual bool isCurrent(const Handle& handle) = 0;
+};
+
+class Timer
+{
+public:
+    typedef std::chrono::milliseconds Interval;
+    typedef TimeSource::Timeout Timeout;
+
+    explicit Timer(TimeSource& timeSource) : _timeSource(timeSource), _slot(timeSource.allocateSlot()) {}
+    ~Timer() { _timeSource.releaseSlot(_slot); }
+
+    Timer(Timer const&) = delete;
+    Timer& operator=(Timer const&) = delete;
+
+    void start(const Interval &interval, const Timeout &timeout) {
+        _timeSource.arm(_slot, _timeSource.now() + std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count(), timeout);
+    }
+
+    // deadline in time source nanoseconds
+    void startAt(int64_t deadline, const Timeout &timeout) {
+        _timeSource.arm(_slot, deadline, timeout);
+    }
+
+    void stop() {
+        _timeSource.cancel(_slot);
+    }
+
+    bool isCurrent(uint32_t generation) {
+        return _timeSource.isCurrent(TimeSource::Handle{_slot, generation});
+    }
+
+private:
+    TimeSource& _timeSource;
+    const uint32_t _slot;
+};
+
+#endif /* TimeSource_hpp */
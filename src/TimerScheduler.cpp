@@ -0,0 +1,133 @@
+//
+//  TimerScheduler.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "TimerScheduler.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+constexpr std::chrono::microseconds TimerScheduler::k_retryDelay;
+
+TimerScheduler& TimerScheduler::GetInstance() {
+    // Intentionally leaked: joining a thread from a static destructor while the
+    // host unloads the plugin can deadlock on the loader lock.
+    static TimerScheduler* instance = new TimerScheduler();
+    return *instance;
+}
+
+int64_t TimerScheduler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+uint32_t TimerScheduler::allocateSlot() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_freeSlots.empty()) {
+        uint32_t index = _freeSlots.back();
+        _freeSlots.pop_back();
+        return index;
+    }
+    assert(_slotCount < k_maxChunks * k_slotsPerChunk);
+    if (_slotCount % k_slotsPerChunk == 0) {
+        _chunks[_slotCount / k_slotsPerChunk].reset(new Slot[k_slotsPerChunk]);
+    }
+    return _slotCount++;
+}
+
+void TimerScheduler::releaseSlot(uint32_t index) {
+    Slot& s = slot(index);
+    {
+        std::lock_guard<std::recursive_mutex> dispatchLock(s.dispatchMutex);
+        s.generation++;
+        s.timeout = nullptr;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _freeSlots.push_back(index);
+}
+
+TimeSource::Handle TimerScheduler::arm(uint32_t index, int64_t deadlineNanoseconds, const Timeout& timeout) {
+    Clock::time_point deadline(std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(deadlineNanoseconds)));
+    Slot& s = slot(index);
+    Handle handle;
+    {
+        std::lock_guard<std::recursive_mutex> dispatchLock(s.dispatchMutex);
+        s.timeout = timeout;
+        handle = Handle{index, ++s.generation};
+    }
+    bool wakeUp;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_started) {
+            _started = true;
+            _thread = std::thread(&TimerScheduler::run, this);
+            _thread.detach();
+        }
+
+        wakeUp = _heap.empty() || deadline < _heap.front().deadline;
+        _heap.push_back(Entry{deadline, index, handle.generation});
+        std::push_heap(_heap.begin(), _heap.end(), std::greater<Entry>());
+    }
+    if (wakeUp) {
+        _wakeUp.notify_one();
+    }
+    return handle;
+}
+
+void TimerScheduler::cancel(uint32_t index) {
+    Slot& s = slot(index);
+    std::lock_guard<std::recursive_mutex> dispatchLock(s.dispatchMutex);
+    s.generation++;
+}
+
+bool TimerScheduler::isCurrent(const Handle& handle) {
+    return slot(handle.slot).generation.load() == handle.generation;
+}
+
+void TimerScheduler::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        if (_heap.empty()) {
+            _wakeUp.wait(lock);
+            continue;
+        }
+
+        Entry next = _heap.front();
+        if (slot(next.slot).generation.load(std::memory_order_relaxed) != next.generation) { // cancelled or re-armed since it was queued
+            std::pop_heap(_heap.begin(), _heap.end(), std::greater<Entry>());
+            _heap.pop_back();
+            continue;
+        }
+
+        if (Clock::now() < next.deadline) {
+            _wakeUp.wait_until(lock, next.deadline);
+            continue;
+        }
+
+        std::pop_heap(_heap.begin(), _heap.end(), std::greater<Entry>());
+        _heap.pop_back();
+
+        lock.unlock();
+        bool retry = dispatch(next);
+        lock.lock();
+        if (retry) {
+            // Queued once the dispatch lock is released, so a cancel() waiting for it (say from
+            // the executor the timeout couldn't reach) gets through first and makes it stale.
+            _heap.push_back(Entry{Clock::now() + k_retryDelay, next.slot, next.generation});
+            std::push_heap(_heap.begin(), _heap.end(), std::greater<Entry>());
+        }
+    }
+}
+
+// Runs the entry's timeout unless the slot was cancelled or re-armed. Returns true if the
+// timeout couldn't be delivered and is to run again.
+bool TimerScheduler::dispatch(const Entry& entry) {
+    Slot& s = slot(entry.slot);
+    // Re-validated with the slot's dispatch lock held so a concurrent cancel() either
+    // lands before this check or waits until the timeout has finished.
+    std::lock_guard<std::recursive_mutex> dispatchLock(s.dispatchMutex);
+    if (s.generation.load(std::memory_order_relaxed) != entry.generation) {
+        return false;
+    }
+    return !s.timeout(entry.generation);
+}
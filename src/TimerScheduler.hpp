@@ -0,0 +1,90 @@
+//
+//  TimerScheduler.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef TimerScheduler_hpp
+#define TimerScheduler_hpp
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TimeSource.hpp"
+
+// Single background thread that owns every pending timeout of the real-time sessions.
+// Deadlines live in a min-heap on steady_clock; each Timer owns a slot whose
+// generation counter is bumped on every arm/cancel, so heap entries left behind
+// by a cancelled or re-armed timer are recognised as stale and dropped.
+// The sessions share only the heap's lock, taken briefly to arm a timer and never while
+// a timeout runs. Cancelling and checking a timer touch its own slot alone: the generation
+// is atomic and each slot has its own dispatch lock, so a timeout running for one session
+// never holds up another session's timers.
+class TimerScheduler : public TimeSource {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static TimerScheduler& GetInstance();
+
+    TimerScheduler(TimerScheduler const&) = delete;
+    TimerScheduler(TimerScheduler&&) = delete;
+    TimerScheduler& operator=(TimerScheduler const&) = delete;
+    TimerScheduler& operator=(TimerScheduler &&) = delete;
+
+    int64_t now() override;
+
+    uint32_t allocateSlot() override;
+    void releaseSlot(uint32_t slot) override;
+
+    Handle arm(uint32_t slot, int64_t deadline, const Timeout& timeout) override;
+    void cancel(uint32_t slot) override;
+    bool isCurrent(const Handle& handle) override;
+
+private:
+    TimerScheduler() {}
+    ~TimerScheduler() {}
+
+    struct Slot {
+        std::atomic<uint32_t> generation{0};
+        // Held while the slot's timeout runs so cancel() from another thread waits for it.
+        std::recursive_mutex dispatchMutex;
+        Timeout timeout;        // under dispatchMutex
+    };
+
+    struct Entry {
+        Clock::time_point deadline;
+        uint32_t slot;
+        uint32_t generation;
+
+        bool operator>(const Entry& other) const { return deadline > other.deadline; }
+    };
+
+    // Slots live in chunks that never move, so they are reached without the lock.
+    Slot& slot(uint32_t index) { return _chunks[index / k_slotsPerChunk][index % k_slotsPerChunk]; }
+    void run();
+    bool dispatch(const Entry& entry);
+
+private:
+    // How long a timeout that couldn't be delivered waits before it runs again.
+    static constexpr std::chrono::microseconds k_retryDelay{100};
+    // Two slots per channel: room for thousands of sessions at once.
+    static const uint32_t k_slotsPerChunk = 64;
+    static const uint32_t k_maxChunks = 1024;
+
+    std::mutex _mutex;          // the heap, the thread and slot allocation
+    std::condition_variable _wakeUp;
+    std::thread _thread;
+    bool _started = false;
+
+    std::unique_ptr<Slot[]> _chunks[k_maxChunks];
+    uint32_t _slotCount = 0;
+    std::vector<uint32_t> _freeSlots;
+    std::vector<Entry> _heap;
+};
+
+#endif /* TimerScheduler_hpp */
@@ -0,0 +1,37 @@
+//
+//  TimingHistogram.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "TimingHistogram.hpp"
+
+void TimingHistogram::record(int64_t nanoseconds) {
+    if (nanoseconds < 0) {
+        nanoseconds = 0;
+    }
+    increment(_buckets[bucketIndex(nanoseconds)]);
+    _sum.store(_sum.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds > _maximum.load(std::memory_order_relaxed)) {
+        _maximum.store(nanoseconds, std::memory_order_relaxed);
+    }
+    // last, with release, so a reader that sees the count sees the bucket it was added to
+    _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void TimingHistogram::reset() {
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _maximum.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void TimingHistogram::snapshot(Snapshot& snapshot) const {
+    snapshot.count = _count.load(std::memory_order_acquire);
+    snapshot.sum = _sum.load(std::memory_order_relaxed);
+    snapshot.maximum = _maximum.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < k_bucketCount; i++) {
+        snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,124 @@
+//
+//  TimingHistogram.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef TimingHistogram_hpp
+#define TimingHistogram_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear bucket layout of nanosecond durations: values below 2^SubBucketBits ns get a
+// bucket each, above that every power of two is split into 2^SubBucketBits linear buckets.
+// With no sub-bucket bits this is plain power of two buckets: 0, then [2^(i-1), 2^i).
+template <int SubBucketBits>
+struct LogLinearBuckets {
+    static const int k_subBucketBits = SubBucketBits;
+    static const size_t k_subBuckets = static_cast<size_t>(1) << SubBucketBits;
+    static const size_t k_count = (63 - SubBucketBits + 1) * k_subBuckets;  // up to INT64_MAX
+
+    // Negative values count as 0.
+    static size_t index(int64_t nanoseconds) {
+        uint64_t value = nanoseconds > 0 ? static_cast<uint64_t>(nanoseconds) : 0;
+        if (value < k_subBuckets) {
+            return static_cast<size_t>(value);
+        }
+        int magnitude = highestBit(value);
+        size_t subBucket = static_cast<size_t>(value >> (magnitude - SubBucketBits)) & (k_subBuckets - 1);
+        return (magnitude - SubBucketBits + 1) * k_subBuckets + subBucket;
+    }
+
+    // Smallest value counted in the bucket.
+    static int64_t start(size_t index) {
+        if (index < k_subBuckets) {
+            return static_cast<int64_t>(index);
+        }
+        int magnitude = static_cast<int>(index / k_subBuckets) + SubBucketBits - 1;
+        uint64_t subBucket = index % k_subBuckets;
+        return static_cast<int64_t>((k_subBuckets + subBucket) << (magnitude - SubBucketBits));
+    }
+
+    // Middle of the bucket holding the quantile, capped at the maximum.
+    static int64_t quantile(const uint64_t (&buckets)[k_count], int64_t maximum, double quantile) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < k_count; i++) {
+            total += buckets[i];
+        }
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(quantile * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < k_count; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                int64_t bucketStart = start(i);
+                int64_t bucketEnd = i + 1 < k_count ? start(i + 1) : INT64_MAX;
+                int64_t middle = bucketStart + (bucketEnd - bucketStart) / 2;
+                return middle < maximum ? middle : maximum;
+            }
+        }
+        return maximum;
+    }
+
+private:
+    static int highestBit(uint64_t value) {
+        int bit = 0;
+        while (value >>= 1) {
+            bit++;
+        }
+        return bit;
+    }
+};
+
+// Log-linear histogram of nanosecond durations: values below 8 ns get a bucket each, above
+// that every power of two is split into 8 linear buckets, so a bucket is at most 12.5% wide.
+// One writer (the executor) records with relaxed atomics, any thread may take a snapshot.
+class TimingHistogram {
+public:
+    typedef LogLinearBuckets<3> Buckets;
+
+    static const int k_subBucketBits = Buckets::k_subBucketBits;
+    static const size_t k_subBuckets = Buckets::k_subBuckets;
+    static const size_t k_bucketCount = Buckets::k_count;
+
+    static size_t bucketIndex(int64_t nanoseconds) { return Buckets::index(nanoseconds); }
+    // Smallest value counted in the bucket.
+    static int64_t bucketStart(size_t index) { return Buckets::start(index); }
+
+    struct Snapshot {
+        uint64_t count = 0;
+        int64_t sum = 0;
+        int64_t maximum = 0;
+        uint64_t buckets[k_bucketCount];
+
+        double mean() const { return count > 0 ? static_cast<double>(sum) / count : 0; }
+        // Middle of the bucket holding the quantile, capped at the maximum.
+        int64_t quantile(double quantile) const { return Buckets::quantile(buckets, maximum, quantile); }
+    };
+
+    TimingHistogram() { reset(); }
+
+    TimingHistogram(TimingHistogram const&) = delete;
+    TimingHistogram& operator=(TimingHistogram const&) = delete;
+
+    // Writer only. Negative values count as 0.
+    void record(int64_t nanoseconds);
+    void reset();
+
+    void snapshot(Snapshot& snapshot) const;
+
+private:
+    static void increment(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> _count;
+    std::atomic<int64_t> _sum;
+    std::atomic<int64_t> _maximum;
+    std::atomic<uint64_t> _buckets[k_bucketCount];
+};
+
+#endif /* TimingHistogram_hpp */
@@ -0,0 +1,84 @@
+//
+//  VirtualTimeSource.cpp
+//  SecondaryTaskPlugin
+//
+
+#include "VirtualTimeSource.hpp"
+
+#include <algorithm>
+
+uint32_t VirtualTimeSource::allocateSlot() {
+    if (!_freeSlots.empty()) {
+        uint32_t slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        return slot;
+    }
+    _slots.push_back(Slot{0, false, nullptr});
+    return static_cast<uint32_t>(_slots.size() - 1);
+}
+
+void VirtualTimeSource::releaseSlot(uint32_t slot) {
+    cancel(slot);
+    _slots[slot].timeout = nullptr;
+    _freeSlots.push_back(slot);
+}
+
+TimeSource::Handle VirtualTimeSource::arm(uint32_t slot, int64_t deadline, const Timeout& timeout) {
+    Slot& s = _slots[slot];
+    s.generation++;
+    s.armed = true;
+    s.timeout = timeout;
+    _heap.push_back(Entry{std::max(deadline, _now), _armCount++, slot, s.generation});
+    std::push_heap(_heap.begin(), _heap.end(), std::greater<Entry>());
+    return Handle{slot, s.generation};
+}
+
+void VirtualTimeSource::cancel(uint32_t slot) {
+    Slot& s = _slots[slot];
+    s.generation++;
+    s.armed = false;
+}
+
+bool VirtualTimeSource::isCurrent(const Handle& handle) {
+    return _slots[handle.slot].generation == handle.generation;
+}
+
+void VirtualTimeSource::dropStaleEntries() {
+    while (!_heap.empty()) {
+        const Entry& top = _heap.front();
+        const Slot& s = _slots[top.slot];
+        if (s.armed && s.generation == top.generation) {
+            return;
+        }
+        std::pop_heap(_heap.begin(), _heap.end(), std::greater<Entry>());
+        _heap.pop_back();
+    }
+}
+
+int64_t VirtualTimeSource::nextDeadline() {
+    dropStaleEntries();
+    return _heap.empty() ? -1 : _heap.front().deadline;
+}
+
+bool VirtualTimeSource::fireNext(int64_t limit) {
+    dropStaleEntries();
+    if (_heap.empty() || _heap.front().deadline > limit) {
+        return false;
+    }
+    Entry next = _heap.front();
+    std::pop_heap(_heap.begin(), _heap.end(), std::greater<Entry>());
+    _heap.pop_back();
+
+    _now = next.deadline;
+    Slot& s = _slots[next.slot];
+    s.armed = false;
+    Timeout timeout = s.timeout;
+    timeout(next.generation);   // virtual sessions run the work inline, it is always delivered
+    return true;
+}
+
+void VirtualTimeSource::advanceTo(int64_t target) {
+    while (fireNext(target)) {
+    }
+    _now = std::max(_now, target);
+}
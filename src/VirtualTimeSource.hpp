@@ -0,0 +1,69 @@
+//
+//  VirtualTimeSource.hpp
+//  SecondaryTaskPlugin
+//
+
+#ifndef VirtualTimeSource_hpp
+#define VirtualTimeSource_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include "TimeSource.hpp"
+
+// Deterministic simulated clock. Time only moves when the owner advances it,
+// and advancing jumps straight from one pending deadline to the next, running
+// each timeout on the calling thread. Not thread safe: a virtual session is
+// driven from a single thread.
+class VirtualTimeSource : public TimeSource {
+public:
+    VirtualTimeSource() {}
+
+    VirtualTimeSource(VirtualTimeSource const&) = delete;
+    VirtualTimeSource& operator=(VirtualTimeSource const&) = delete;
+
+    int64_t now() override { return _now; }
+
+    uint32_t allocateSlot() override;
+    void releaseSlot(uint32_t slot) override;
+
+    Handle arm(uint32_t slot, int64_t deadline, const Timeout& timeout) override;
+    void cancel(uint32_t slot) override;
+    bool isCurrent(const Handle& handle) override;
+
+    // Earliest live deadline, or -1 when nothing is pending.
+    int64_t nextDeadline();
+    // Jumps to the next deadline not later than limit and runs its timeout.
+    bool fireNext(int64_t limit);
+    // Runs every timeout due up to target, then leaves the clock at target.
+    void advanceTo(int64_t target);
+
+private:
+    struct Slot {
+        uint32_t generation;
+        bool armed;
+        Timeout timeout;
+    };
+
+    struct Entry {
+        int64_t deadline;
+        uint64_t order;     // arm order breaks ties between equal deadlines
+        uint32_t slot;
+        uint32_t generation;
+
+        bool operator>(const Entry& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : order > other.order;
+        }
+    };
+
+    void dropStaleEntries();
+
+private:
+    int64_t _now = 0;
+    uint64_t _armCount = 0;
+    std::vector<Slot> _slots;
+    std::vector<uint32_t> _freeSlots;
+    std::vector<Entry> _heap;
+};
+
+#endif /* VirtualTimeSource_hpp */
@@ -7,121 +7,1292 @@
 
 #include "main.hpp"
 
+#include "BinaryExport.hpp"
+#include "ExportWorker.hpp"
+#include "JsonExport.hpp"
+#include "CallMetrics.hpp"
 #include "StateMachine.hpp"
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+static StateMachine& toStateMachine(SessionHandle session) {
+    return *reinterpret_cast<StateMachine*>(session);
+}
+
+static SessionHandle defaultSession() {
+    return reinterpret_cast<SessionHandle>(&StateMachine::GetInstance());
+}
+
+static int64_t toNanoseconds(unsigned milliseconds) {
+    return static_cast<int64_t>(milliseconds) * 1000000;
+}
+
+// The API struct is handed to the session as is.
+static_assert(sizeof(TelemetryEvent) == sizeof(TelemetrySample) && offsetof(TelemetryEvent, fields) == offsetof(TelemetrySample, fields),
+              "TelemetryEvent and TelemetrySample must share their layout");
+
+static void traceTelemetry(StateMachine& stateMachine, const TelemetrySample* samples, size_t count) {
+    std::vector<uint64_t> values;
+    values.reserve(1 + count * (2 + TelemetrySample::k_maxFields));
+    values.push_back(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t fieldCount = samples[i].fieldCount < TelemetrySample::k_maxFields ? samples[i].fieldCount : TelemetrySample::k_maxFields;
+        values.push_back(samples[i].id);
+        values.push_back(fieldCount);
+        for (uint32_t field = 0; field < fieldCount; field++) {
+            uint32_t bits;
+            memcpy(&bits, &samples[i].fields[field], sizeof(bits));
+            values.push_back(bits);
+        }
+    }
+    stateMachine.traceNumbers(CallTraceFormat::AddTelemetry, values.data(), values.size());
+}
+
+static_assert(EntryPointCount <= CallMetrics::k_maxEntryPoints, "CallMetrics needs a counter per entry point");
+static_assert(sizeof(PluginMetrics::transitions) / sizeof(LatencyMetrics) == sizeof(CallMetrics::Snapshot::transitions) / sizeof(CallMetrics::Latency), "PluginMetrics must have a latency per event and state");
+
+static void toLatencyMetrics(const CallMetrics::Latency& latency, LatencyMetrics& metrics) {
+    const double nsPerUs = 1000.0;
+    metrics.calls = latency.calls;
+    metrics.mean = latency.mean() / nsPerUs;
+    metrics.median = latency.quantile(0.5) / nsPerUs;
+    metrics.p99 = latency.quantile(0.99) / nsPerUs;
+    metrics.max = latency.maximum / nsPerUs;
+}
+
+static bool isTimingMeasure(TimingMeasure measure) {
+    return measure >= TimingSignalTimerLateness && measure <= TimingCommandDispatchLag;
+}
+
+// Cursor layout: low 48 bits are the next record index, high 16 bits the store epoch it belongs to.
+static const int k_cursorIndexBits = 48;
+static const ExportCursor k_cursorIndexMask = (1ull << k_cursorIndexBits) - 1;
+
+static ExportCursor makeCursor(uint32_t epoch, size_t index) {
+    return (static_cast<ExportCursor>(epoch & 0xffff) << k_cursorIndexBits) | index;
+}
+
+static size_t cursorIndex(ExportCursor cursor) {
+    return static_cast<size_t>(cursor & k_cursorIndexMask);
+}
+
+static bool cursorMatches(ExportCursor cursor, uint32_t epoch) {
+    return (cursor >> k_cursorIndexBits) == (epoch & 0xffff);
+}
+
+// Records an export of kind covers: everything, or what was appended after the cursor.
+static SessionStore::Snapshot snapshotSince(const SessionStore& store, ExportKind kind, const ExportCursor* cursor) {
+    size_t from = cursor != nullptr ? cursorIndex(*cursor) : 0;
+    size_t reactionsFrom = kind == ExportReactions ? from : SIZE_MAX;
+    size_t eventsFrom = kind == ExportEvents ? from : SIZE_MAX;
+    size_t telemetryFrom = kind == ExportTelemetry ? from : SIZE_MAX;
+    SessionStore::Snapshot snapshot = store.snapshot(reactionsFrom, eventsFrom, telemetryFrom);
+    if (cursor != nullptr && from != 0 && !cursorMatches(*cursor, snapshot.epoch)) {
+        snapshot = store.snapshot(reactionsFrom == SIZE_MAX ? SIZE_MAX : 0, eventsFrom == SIZE_MAX ? SIZE_MAX : 0,
+                                  telemetryFrom == SIZE_MAX ? SIZE_MAX : 0);
+    }
+    return snapshot;
+}
+
+// Waits for the session's pending commands so the export includes the calls made before it.
+static SessionStore::Snapshot exportSnapshot(StateMachine& stateMachine, ExportKind kind, const ExportCursor* cursor) {
+    stateMachine.waitForPendingCommands();
+    return snapshotSince(stateMachine.store(), kind, cursor);
+}
+
+static ExportCursor cursorAfter(const SessionStore::Snapshot& snapshot, ExportKind kind) {
+    switch (kind) {
+        case ExportReactions: return makeCursor(snapshot.epoch, snapshot.reactions.end());
+        case ExportEvents: return makeCursor(snapshot.epoch, snapshot.events.end());
+        case ExportTelemetry: return makeCursor(snapshot.epoch, snapshot.telemetry.end());
+        default: return makeCursor(snapshot.epoch, snapshot.positions.end());
+    }
+}
+
+static JsonExportOptions exportOptions(const StateMachine& stateMachine) {
+    JsonExportOptions options;
+    options.highResolution = stateMachine.isHighResolutionTiming();
+    options.positionIds = stateMachine.isExportingPositionIds();
+    options.channels = stateMachine.channelCount() > 1;
+    return options;
+}
+
+static void writeExport(JsonWriter& writer, const JsonExportOptions& options, const SessionStore::Snapshot& snapshot, ExportKind kind) {
+    switch (kind) {
+        case ExportReactions: writeReactionsJson(writer, snapshot, options); break;
+        case ExportEvents: writeEventsJson(writer, snapshot, options); break;
+        case ExportTelemetry: writeTelemetryJson(writer, snapshot, options); break;
+        default: writePositionDictionaryJson(writer, snapshot); break;
+    }
+}
+
+static size_t estimateExport(const SessionStore::Snapshot& snapshot, ExportKind kind) {
+    switch (kind) {
+        case ExportReactions: return estimateReactionsJson(snapshot);
+        case ExportEvents: return estimateEventsJson(snapshot);
+        case ExportTelemetry: return estimateTelemetryJson(snapshot);
+        default: return estimatePositionDictionaryJson(snapshot);
+    }
+}
+
+// Null terminated export on the heap, released with freeExportedData. Written in one
+// pass into a buffer sized from the record count, and rewritten only if that was too small.
+static char* exportData(SessionHandle session, ExportKind kind, ExportCursor* cursor) {
+    StateMachine& stateMachine = toStateMachine(session);
+    SessionStore::Snapshot snapshot = exportSnapshot(stateMachine, kind, cursor);
+    size_t capacity = estimateExport(snapshot, kind);
+    char* data = (char*)malloc(capacity);
+    JsonWriter writer(data, capacity);
+    JsonExportOptions options = exportOptions(stateMachine);
+    writeExport(writer, options, snapshot, kind);
+    if (!writer.terminate()) {
+        capacity = writer.size() + 1;
+        free(data);
+        data = (char*)malloc(capacity);
+        JsonWriter exactWriter(data, capacity);
+        writeExport(exactWriter, options, snapshot, kind);
+        exactWriter.terminate();
+    }
+    if (cursor != nullptr) {
+        *cursor = cursorAfter(snapshot, kind);
+    }
+    return data;
+}
+
+static size_t estimateExportJob(const ExportJob& job) {
+    return estimateExport(job.snapshot, static_cast<ExportKind>(job.kind));
+}
+
+static void writeExportJob(JsonWriter& writer, const ExportJob& job) {
+    writeExport(writer, job.options, job.snapshot, static_cast<ExportKind>(job.kind));
+}
+
+// Runs on the session's executor, after the calls made before the request: the snapshot only
+// copies chunk references, so measurement carries on while the worker serialises it.
+static void snapshotForExport(StateMachine& stateMachine, void* context) {
+    std::unique_ptr<ExportJob> job(static_cast<ExportJob*>(context));
+    ExportKind kind = static_cast<ExportKind>(job->kind);
+    ExportCursor since = job->next;
+    job->snapshot = snapshotSince(stateMachine.store(), kind, &since);
+    job->next = cursorAfter(job->snapshot, kind);
+    ExportWorker::GetInstance().submit(std::move(job));
+}
 
 extern "C"
 {
 
+#pragma mark - Sessions
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    SessionHandle createSession() {
+        CallMetrics::Scope scope(EntryCreateSession);
+        return reinterpret_cast<SessionHandle>(new StateMachine());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    SessionHandle createVirtualSession() {
+        CallMetrics::Scope scope(EntryCreateSession);
+        return reinterpret_cast<SessionHandle>(new StateMachine(true));
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void destroySession(SessionHandle session) {
+        CallMetrics::Scope scope(EntryDestroySession);
+        if (session == nullptr || session == defaultSession()) {
+            return;
+        }
+        // Requests still queued hand their jobs to the worker once they run, so they run first;
+        // then nothing of the session is left with the worker when its address is freed for reuse.
+        StateMachine& stateMachine = toStateMachine(session);
+        stateMachine.waitForPendingCommands();
+        ExportWorker::GetInstance().discard(session);
+        delete &stateMachine;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionInitializeStimulusHandler(SessionHandle session, void (*signalHandler)(), void (*signalStopHandler)(), void (*debugLogHandler)(const char*)) {
+        CallMetrics::Scope scope(EntryInitializeStimulusHandler);
+        toStateMachine(session).submitCallbacks(signalHandler, signalStopHandler, debugLogHandler);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionStartMeasurement(SessionHandle session) {
+        CallMetrics::Scope scope(EntryStartMeasurement);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.isTracing()) {
+            stateMachine.traceNumbers(CallTraceFormat::StartMeasurement, nullptr, 0);
+        }
+        stateMachine.submitEvent(Event::StartMeasure);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionRespondToStimulus(SessionHandle session, const char* pos) {
+        sessionChannelRespondToStimulus(session, 0, pos);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionStopMeasurement(SessionHandle session) {
+        CallMetrics::Scope scope(EntryStopMeasurement);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.isTracing()) {
+            stateMachine.traceNumbers(CallTraceFormat::StopMeasurement, nullptr, 0);
+        }
+        stateMachine.submitReset();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddMilestone(SessionHandle session) {
+        CallMetrics::Scope scope(EntryAddMilestone);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.isTracing()) {
+            stateMachine.traceNumbers(CallTraceFormat::AddMilestone, nullptr, 0);
+        }
+        stateMachine.submitMilestone();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddEventLog(SessionHandle session, const char* eventName) {
+        CallMetrics::Scope scope(EntryAddEventLog);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.isTracing()) {
+            stateMachine.traceText(CallTraceFormat::AddEventLog, eventName);
+        }
+        stateMachine.submitLogEvent(eventName);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddTelemetryEvent(SessionHandle session, unsigned int id, const float* fields, size_t fieldCount) {
+        TelemetryEvent event;
+        event.id = id;
+        if (fields == nullptr) {
+            fieldCount = 0;
+        }
+        event.fieldCount = fieldCount < TelemetrySample::k_maxFields ? static_cast<unsigned int>(fieldCount) : TelemetrySample::k_maxFields;
+        if (event.fieldCount > 0) {
+            memcpy(event.fields, fields, event.fieldCount * sizeof(float));
+        }
+        sessionAddEventLogBatch(session, &event, 1);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddEventLogBatch(SessionHandle session, const TelemetryEvent* events, size_t count) {
+        CallMetrics::Scope scope(EntryAddTelemetry);
+        StateMachine& stateMachine = toStateMachine(session);
+        const TelemetrySample* samples = reinterpret_cast<const TelemetrySample*>(events);
+        if (samples == nullptr) {
+            count = 0;
+        }
+        if (stateMachine.isTracing()) {
+            traceTelemetry(stateMachine, samples, count);
+        }
+        stateMachine.submitTelemetry(samples, count);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetHighResolutionTiming(SessionHandle session, bool enabled) {
+        CallMetrics::Scope scope(EntrySetOption);
+        toStateMachine(session).setHighResolutionTiming(enabled);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetExportPositionIds(SessionHandle session, bool enabled) {
+        CallMetrics::Scope scope(EntrySetOption);
+        toStateMachine(session).setExportPositionIds(enabled);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetLogLevel(SessionHandle session, int level) {
+        CallMetrics::Scope scope(EntrySetOption);
+        toStateMachine(session).setLogLevel(level);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionDrainDebugLog(SessionHandle session) {
+        CallMetrics::Scope scope(EntryDrainDebugLog);
+        return toStateMachine(session).drainDebugLog();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionEnableJournal(SessionHandle session, const char* path, unsigned flushIntervalMilliseconds) {
+        CallMetrics::Scope scope(EntryJournal);
+        std::unique_ptr<SessionJournal> journal(new SessionJournal(path, flushIntervalMilliseconds));
+        if (!journal->isOpen() || journal->hasFailed()) {
+            return false;
+        }
+        toStateMachine(session).submitJournal(std::move(journal));
+        return true;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionDisableJournal(SessionHandle session) {
+        CallMetrics::Scope scope(EntryJournal);
+        toStateMachine(session).submitJournal(nullptr);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionFlushJournal(SessionHandle session) {
+        CallMetrics::Scope scope(EntryJournal);
+        return toStateMachine(session).flushJournal();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetUniformSchedule(SessionHandle session, unsigned minMilliseconds, unsigned maxMilliseconds) {
+        sessionChannelSetUniformSchedule(session, 0, minMilliseconds, maxMilliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetExponentialSchedule(SessionHandle session, unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds) {
+        sessionChannelSetExponentialSchedule(session, 0, minMilliseconds, meanMilliseconds, maxMilliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetScheduleList(SessionHandle session, const unsigned* intervalsMilliseconds, size_t count) {
+        sessionChannelSetScheduleList(session, 0, intervalsMilliseconds, count);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetStimulusSeed(SessionHandle session, unsigned long long seed) {
+        CallMetrics::Scope scope(EntrySetStimulusSeed);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.isTracing()) {
+            uint64_t value = seed;
+            stateMachine.traceNumbers(CallTraceFormat::SetStimulusSeed, &value, 1);
+        }
+        stateMachine.submitSeed(seed);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionPeekNextStimulusTime(SessionHandle session) {
+        CallMetrics::Scope scope(EntryPeekNextStimulusTime);
+        return toStateMachine(session).peekNextStimulusTime();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetPollMode(SessionHandle session, bool enabled) {
+        CallMetrics::Scope scope(EntrySetOption);
+        toStateMachine(session).setPollMode(enabled);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionPollStimulus(SessionHandle session, long long frameTimestamp) {
+        CallMetrics::Scope scope(EntryPollStimulus);
+        return toStateMachine(session).pollStimulus(frameTimestamp);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionReportStimulusPresented(SessionHandle session, long long presentTimestamp) {
+        CallMetrics::Scope scope(EntryReportStimulusPresented);
+        toStateMachine(session).submitStimulusPresented(presentTimestamp);
+    }
+
+#pragma mark - Stimulus Channels
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    int sessionAddStimulusChannel(SessionHandle session) {
+        CallMetrics::Scope scope(EntryAddStimulusChannel);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.isTracing()) {
+            stateMachine.traceNumbers(CallTraceFormat::AddChannel, nullptr, 0);
+        }
+        return stateMachine.addChannel();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelInitializeStimulusHandler(SessionHandle session, unsigned channel, void (*signalHandler)(), void (*signalStopHandler)()) {
+        CallMetrics::Scope scope(EntryInitializeStimulusHandler);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.hasChannel(channel)) {
+            stateMachine.submitChannelCallbacks(channel, signalHandler, signalStopHandler);
+        }
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelRespondToStimulus(SessionHandle session, unsigned channel, const char* pos) {
+        CallMetrics::Scope scope(EntryRespondToStimulus);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (!stateMachine.hasChannel(channel)) {
+            return;
+        }
+        if (stateMachine.isTracing()) {
+            stateMachine.traceChannelText(channel, CallTraceFormat::RespondToStimulus, pos);
+        }
+        stateMachine.submitResponse(pos, channel);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetUniformSchedule(SessionHandle session, unsigned channel, unsigned minMilliseconds, unsigned maxMilliseconds) {
+        CallMetrics::Scope scope(EntrySetSchedule);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (!stateMachine.hasChannel(channel)) {
+            return;
+        }
+        if (stateMachine.isTracing()) {
+            uint64_t values[] = {minMilliseconds, maxMilliseconds};
+            stateMachine.traceChannelNumbers(channel, CallTraceFormat::SetUniformSchedule, values, 2);
+        }
+        stateMachine.submitSchedule(StimulusSchedule::uniform(toNanoseconds(minMilliseconds), toNanoseconds(maxMilliseconds)), channel);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetExponentialSchedule(SessionHandle session, unsigned channel, unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds) {
+        CallMetrics::Scope scope(EntrySetSchedule);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (!stateMachine.hasChannel(channel)) {
+            return;
+        }
+        if (stateMachine.isTracing()) {
+            uint64_t values[] = {minMilliseconds, meanMilliseconds, maxMilliseconds};
+            stateMachine.traceChannelNumbers(channel, CallTraceFormat::SetExponentialSchedule, values, 3);
+        }
+        stateMachine.submitSchedule(StimulusSchedule::exponential(toNanoseconds(minMilliseconds), toNanoseconds(meanMilliseconds),
+                                                                  toNanoseconds(maxMilliseconds)), channel);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetScheduleList(SessionHandle session, unsigned channel, const unsigned* intervalsMilliseconds, size_t count) {
+        CallMetrics::Scope scope(EntrySetSchedule);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (intervalsMilliseconds == nullptr || count == 0 || !stateMachine.hasChannel(channel)) {
+            return;
+        }
+        if (stateMachine.isTracing()) {
+            std::vector<uint64_t> values(1, count);
+            values.insert(values.end(), intervalsMilliseconds, intervalsMilliseconds + count);
+            stateMachine.traceChannelNumbers(channel, CallTraceFormat::SetScheduleList, values.data(), values.size());
+        }
+        std::vector<int64_t> intervals(count);
+        for (size_t i = 0; i < count; i++) {
+            intervals[i] = toNanoseconds(intervalsMilliseconds[i]);
+        }
+        stateMachine.submitSchedule(StimulusSchedule::list(intervals.data(), count), channel);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetResponseTimeout(SessionHandle session, unsigned channel, unsigned milliseconds) {
+        CallMetrics::Scope scope(EntrySetOption);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (milliseconds == 0 || !stateMachine.hasChannel(channel)) {
+            return;
+        }
+        if (stateMachine.isTracing()) {
+            uint64_t value = milliseconds;
+            stateMachine.traceChannelNumbers(channel, CallTraceFormat::SetResponseTimeout, &value, 1);
+        }
+        stateMachine.submitResponseTimeout(toNanoseconds(milliseconds), channel);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionChannelPeekNextStimulusTime(SessionHandle session, unsigned channel) {
+        CallMetrics::Scope scope(EntryPeekNextStimulusTime);
+        StateMachine& stateMachine = toStateMachine(session);
+        return stateMachine.hasChannel(channel) ? stateMachine.peekNextStimulusTime(channel) : -1;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetPollMode(SessionHandle session, unsigned channel, bool enabled) {
+        CallMetrics::Scope scope(EntrySetOption);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.hasChannel(channel)) {
+            stateMachine.setPollMode(enabled, channel);
+        }
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionChannelPollStimulus(SessionHandle session, unsigned channel, long long frameTimestamp) {
+        CallMetrics::Scope scope(EntryPollStimulus);
+        StateMachine& stateMachine = toStateMachine(session);
+        return stateMachine.hasChannel(channel) && stateMachine.pollStimulus(frameTimestamp, channel);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelReportStimulusPresented(SessionHandle session, unsigned channel, long long presentTimestamp) {
+        CallMetrics::Scope scope(EntryReportStimulusPresented);
+        StateMachine& stateMachine = toStateMachine(session);
+        if (stateMachine.hasChannel(channel)) {
+            stateMachine.submitStimulusPresented(presentTimestamp, channel);
+        }
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionGetMilestoneStats(SessionHandle session, unsigned index, MilestoneStats* stats) {
+        CallMetrics::Scope scope(EntryGetStatistics);
+        ReactionStats reactionStats;
+        if (stats == nullptr || !toStateMachine(session).milestoneStats(index, reactionStats)) {
+            return false;
+        }
+        const double usPerMs = 1000.0;
+        stats->responses = reactionStats.responses;
+        stats->timeouts = reactionStats.timeouts;
+        stats->falseStarts = reactionStats.falseStarts;
+        stats->mean = reactionStats.mean / usPerMs;
+        stats->variance = reactionStats.variance() / (usPerMs * usPerMs);
+        stats->min = reactionStats.minimum / usPerMs;
+        stats->max = reactionStats.maximum / usPerMs;
+        stats->median = reactionStats.median.value() / usPerMs;
+        stats->p90 = reactionStats.p90.value() / usPerMs;
+        return true;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionGetTimingSummary(SessionHandle session, TimingMeasure measure, TimingSummary* summary) {
+        CallMetrics::Scope scope(EntryGetStatistics);
+        if (summary == nullptr || !isTimingMeasure(measure)) {
+            return false;
+        }
+        TimingHistogram::Snapshot snapshot;
+        toStateMachine(session).timingSnapshot(measure, snapshot);
+        const double nsPerUs = 1000.0;
+        summary->count = snapshot.count;
+        summary->mean = snapshot.mean() / nsPerUs;
+        summary->median = snapshot.quantile(0.5) / nsPerUs;
+        summary->p90 = snapshot.quantile(0.9) / nsPerUs;
+        summary->p99 = snapshot.quantile(0.99) / nsPerUs;
+        summary->max = snapshot.maximum / nsPerUs;
+        return true;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionGetTimingHistogram(SessionHandle session, TimingMeasure measure, unsigned long long* counts, size_t capacity) {
+        CallMetrics::Scope scope(EntryGetStatistics);
+        if (!isTimingMeasure(measure)) {
+            return 0;
+        }
+        TimingHistogram::Snapshot snapshot;
+        toStateMachine(session).timingSnapshot(measure, snapshot);
+        for (size_t i = 0; i < capacity && i < TimingHistogram::k_bucketCount && counts != nullptr; i++) {
+            counts[i] = snapshot.buckets[i];
+        }
+        return TimingHistogram::k_bucketCount;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long timingHistogramBucketStart(size_t index) {
+        return index < TimingHistogram::k_bucketCount ? TimingHistogram::bucketStart(index) : -1;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionResetTiming(SessionHandle session) {
+        CallMetrics::Scope scope(EntryGetStatistics);
+        toStateMachine(session).submitTimingReset();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionGetMemoryUsage(SessionHandle session) {
+        CallMetrics::Scope scope(EntryGetStatistics);
+        return toStateMachine(session).store().memoryUsage();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    unsigned long long sessionGetDroppedCalls(SessionHandle session) {
+        CallMetrics::Scope scope(EntryGetStatistics);
+        return toStateMachine(session).droppedCalls();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionStartTrace(SessionHandle session, const char* path) {
+        CallMetrics::Scope scope(EntryTrace);
+        return toStateMachine(session).startTrace(path);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionStopTrace(SessionHandle session) {
+        CallMetrics::Scope scope(EntryTrace);
+        toStateMachine(session).stopTrace();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    SessionHandle recoverSession(const char* journalPath) {
+        CallMetrics::Scope scope(EntryRecoverSession);
+        StateMachine* stateMachine = new StateMachine(true);
+        if (!stateMachine->restoreFromJournal(journalPath)) {
+            delete stateMachine;
+            return nullptr;
+        }
+        return reinterpret_cast<SessionHandle>(stateMachine);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionAdvanceClock(SessionHandle session, long long nanoseconds) {
+        CallMetrics::Scope scope(EntryAdvanceClock);
+        return toStateMachine(session).advanceClock(nanoseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionAdvanceToNextDeadline(SessionHandle session) {
+        CallMetrics::Scope scope(EntryAdvanceClock);
+        return toStateMachine(session).advanceToNextDeadline();
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportReactionData(SessionHandle session) {
+        CallMetrics::Scope scope(EntryExportData);
+        return exportData(session, ExportReactions, nullptr);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportEventsData(SessionHandle session) {
+        CallMetrics::Scope scope(EntryExportData);
+        return exportData(session, ExportEvents, nullptr);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportReactionDataSince(SessionHandle session, ExportCursor* cursor) {
+        CallMetrics::Scope scope(EntryExportData);
+        return exportData(session, ExportReactions, cursor);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportEventsDataSince(SessionHandle session, ExportCursor* cursor) {
+        CallMetrics::Scope scope(EntryExportData);
+        return exportData(session, ExportEvents, cursor);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportTelemetryData(SessionHandle session) {
+        CallMetrics::Scope scope(EntryExportData);
+        return exportData(session, ExportTelemetry, nullptr);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportTelemetryDataSince(SessionHandle session, ExportCursor* cursor) {
+        CallMetrics::Scope scope(EntryExportData);
+        return exportData(session, ExportTelemetry, cursor);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportPositionDictionary(SessionHandle session) {
+        CallMetrics::Scope scope(EntryExportData);
+        return exportData(session, ExportPositionDictionary, nullptr);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionExportDataInto(SessionHandle session, ExportKind kind, ExportCursor* cursor, char* buffer, size_t capacity) {
+        CallMetrics::Scope scope(EntryExportDataInto);
+        StateMachine& stateMachine = toStateMachine(session);
+        SessionStore::Snapshot snapshot = exportSnapshot(stateMachine, kind, cursor);
+        JsonWriter writer(buffer, capacity);
+        writeExport(writer, exportOptions(stateMachine), snapshot, kind);
+        if (writer.terminate() && cursor != nullptr) {
+            *cursor = cursorAfter(snapshot, kind);
+        }
+        return writer.size() + 1;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportRequest sessionRequestExport(SessionHandle session, ExportKind kind, ExportCursor since, void (*completion)(ExportRequest request, void* context), void* context) {
+        CallMetrics::Scope scope(EntryRequestExport);
+        StateMachine& stateMachine = toStateMachine(session);
+        std::unique_ptr<ExportJob> job(new ExportJob());
+        job->request = ExportWorker::GetInstance().reserve(session);
+        job->owner = session;
+        job->options = exportOptions(stateMachine);
+        job->kind = kind;
+        job->next = since;
+        job->estimate = estimateExportJob;
+        job->write = writeExportJob;
+        job->completion = completion;
+        job->context = context;
+        ExportRequest request = job->request;
+        stateMachine.submitTask(snapshotForExport, job.release());
+        return request;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportStatus sessionPollExport(SessionHandle session, ExportRequest request, char** data, size_t* size, ExportCursor* next) {
+        CallMetrics::Scope scope(EntryPollExport);
+        if (data == nullptr) { // only asking, the export stays to be collected
+            switch (ExportWorker::GetInstance().status(request, session)) {
+                case ExportWorker::Ready:
+                    return ExportReady;
+                case ExportWorker::Pending:
+                    return ExportPending;
+                default:
+                    return ExportUnknown;
+            }
+        }
+        char* result = nullptr;
+        size_t resultSize = 0;
+        uint64_t resultNext = 0;
+        switch (ExportWorker::GetInstance().take(request, session, result, resultSize, resultNext)) {
+            case ExportWorker::Ready:
+                *data = result;
+                if (size != nullptr) {
+                    *size = resultSize;
+                }
+                if (next != nullptr) {
+                    *next = resultNext;
+                }
+                return ExportReady;
+            case ExportWorker::Pending:
+                return ExportPending;
+            default:
+                return ExportUnknown;
+        }
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportBinary(SessionHandle session, size_t* size) {
+        CallMetrics::Scope scope(EntryExportBinary);
+        StateMachine& stateMachine = toStateMachine(session);
+        stateMachine.waitForPendingCommands();
+        SessionStore::Snapshot snapshot = stateMachine.store().snapshot();
+        *size = binaryExportSize(snapshot);
+        if (*size == 0) {
+            return nullptr;
+        }
+        char* data = (char*)malloc(*size);
+        writeBinaryExport(reinterpret_cast<unsigned char*>(data), snapshot);
+        return data;
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionExportBinaryInto(SessionHandle session, void* buffer, size_t capacity) {
+        CallMetrics::Scope scope(EntryExportBinary);
+        StateMachine& stateMachine = toStateMachine(session);
+        stateMachine.waitForPendingCommands();
+        SessionStore::Snapshot snapshot = stateMachine.store().snapshot();
+        size_t size = binaryExportSize(snapshot);
+        if (size != 0 && size <= capacity) {
+            writeBinaryExport(static_cast<unsigned char*>(buffer), snapshot);
+        }
+        return size;
+    }
+
+#pragma mark - Default Session
+
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
     void initializeSecondaryTaskWithStimulusHandler(void (*signalHandler)(), void (*signalStopHandler)(), void (*debugLogHandler)(const char*)) {
-        StateMachine::GetInstance().setDebugLogCallback(debugLogHandler);
-        StateMachine::GetInstance().setSignalSendingCallback(signalHandler);
-        StateMachine::GetInstance().setSignalStopCallback(signalStopHandler);
+        sessionInitializeStimulusHandler(defaultSession(), signalHandler, signalStopHandler, debugLogHandler);
     }
 
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
     void startMeasurement() {
-        StateMachine::GetInstance().processEvent(Event::StartMeasure);
+        sessionStartMeasurement(defaultSession());
     }
 
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
     void respondToStimulus(const char* pos) {
-        StateMachine::GetInstance().addPreviousPosition(pos);
-        StateMachine::GetInstance().processEvent(Event::ResponseReceived);
+        sessionRespondToStimulus(defaultSession(), pos);
     }
 
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
     void stopMeasurement() {
-        StateMachine::GetInstance().resetState();
+        sessionStopMeasurement(defaultSession());
     }
 
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
     void addMilestone() {
-        StateMachine::GetInstance().addMilestone();
+        sessionAddMilestone(defaultSession());
     }
 
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
     void addEventLog(const char* eventName) {
-        StateMachine::GetInstance().addLogEvent(eventName);
+        sessionAddEventLog(defaultSession(), eventName);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void addTelemetryEvent(unsigned int id, const float* fields, size_t fieldCount) {
+        sessionAddTelemetryEvent(defaultSession(), id, fields, fieldCount);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void addEventLogBatch(const TelemetryEvent* events, size_t count) {
+        sessionAddEventLogBatch(defaultSession(), events, count);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setHighResolutionTiming(bool enabled) {
+        sessionSetHighResolutionTiming(defaultSession(), enabled);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setLogLevel(int level) {
+        sessionSetLogLevel(defaultSession(), level);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t drainDebugLog() {
+        return sessionDrainDebugLog(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool enableJournal(const char* path, unsigned flushIntervalMilliseconds) {
+        return sessionEnableJournal(defaultSession(), path, flushIntervalMilliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void disableJournal() {
+        sessionDisableJournal(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool flushJournal() {
+        return sessionFlushJournal(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setUniformSchedule(unsigned minMilliseconds, unsigned maxMilliseconds) {
+        sessionSetUniformSchedule(defaultSession(), minMilliseconds, maxMilliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setExponentialSchedule(unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds) {
+        sessionSetExponentialSchedule(defaultSession(), minMilliseconds, meanMilliseconds, maxMilliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setScheduleList(const unsigned* intervalsMilliseconds, size_t count) {
+        sessionSetScheduleList(defaultSession(), intervalsMilliseconds, count);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setStimulusSeed(unsigned long long seed) {
+        sessionSetStimulusSeed(defaultSession(), seed);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long peekNextStimulusTime() {
+        return sessionPeekNextStimulusTime(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setPollMode(bool enabled) {
+        sessionSetPollMode(defaultSession(), enabled);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool pollStimulus(long long frameTimestamp) {
+        return sessionPollStimulus(defaultSession(), frameTimestamp);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void reportStimulusPresented(long long presentTimestamp) {
+        sessionReportStimulusPresented(defaultSession(), presentTimestamp);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    int addStimulusChannel() {
+        return sessionAddStimulusChannel(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelInitializeStimulusHandler(unsigned channel, void (*signalHandler)(), void (*signalStopHandler)()) {
+        sessionChannelInitializeStimulusHandler(defaultSession(), channel, signalHandler, signalStopHandler);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelRespondToStimulus(unsigned channel, const char* pos) {
+        sessionChannelRespondToStimulus(defaultSession(), channel, pos);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetUniformSchedule(unsigned channel, unsigned minMilliseconds, unsigned maxMilliseconds) {
+        sessionChannelSetUniformSchedule(defaultSession(), channel, minMilliseconds, maxMilliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetExponentialSchedule(unsigned channel, unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds) {
+        sessionChannelSetExponentialSchedule(defaultSession(), channel, minMilliseconds, meanMilliseconds, maxMilliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetScheduleList(unsigned channel, const unsigned* intervalsMilliseconds, size_t count) {
+        sessionChannelSetScheduleList(defaultSession(), channel, intervalsMilliseconds, count);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetResponseTimeout(unsigned channel, unsigned milliseconds) {
+        sessionChannelSetResponseTimeout(defaultSession(), channel, milliseconds);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long channelPeekNextStimulusTime(unsigned channel) {
+        return sessionChannelPeekNextStimulusTime(defaultSession(), channel);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetPollMode(unsigned channel, bool enabled) {
+        sessionChannelSetPollMode(defaultSession(), channel, enabled);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool channelPollStimulus(unsigned channel, long long frameTimestamp) {
+        return sessionChannelPollStimulus(defaultSession(), channel, frameTimestamp);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelReportStimulusPresented(unsigned channel, long long presentTimestamp) {
+        sessionChannelReportStimulusPresented(defaultSession(), channel, presentTimestamp);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool getMilestoneStats(unsigned index, MilestoneStats* stats) {
+        return sessionGetMilestoneStats(defaultSession(), index, stats);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool getTimingSummary(TimingMeasure measure, TimingSummary* summary) {
+        return sessionGetTimingSummary(defaultSession(), measure, summary);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t getTimingHistogram(TimingMeasure measure, unsigned long long* counts, size_t capacity) {
+        return sessionGetTimingHistogram(defaultSession(), measure, counts, capacity);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void resetTiming() {
+        sessionResetTiming(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t getMemoryUsage() {
+        return sessionGetMemoryUsage(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    unsigned long long getDroppedCalls() {
+        return sessionGetDroppedCalls(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool startTrace(const char* path) {
+        return sessionStartTrace(defaultSession(), path);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void stopTrace() {
+        sessionStopTrace(defaultSession());
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setExportPositionIds(bool enabled) {
+        sessionSetExportPositionIds(defaultSession(), enabled);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportPositionDictionary() {
+        return sessionExportPositionDictionary(defaultSession());
     }
 
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
     char* exportReactionData() {
-        std::vector<std::map<long, std::pair<long, std::string>>> reactionTimes = StateMachine::GetInstance().getCollectedData().first;
-        std::string result = "[";
-
-        for (int i = 0; i < reactionTimes.size(); i++) {
-            result += "[" + std::to_string(i) + ",";
-            for (auto iter = reactionTimes[i].begin(); iter != reactionTimes[i].end(); ) {
-                result += "[" + std::to_string(iter->first) + "," + std::to_string(iter->second.first) + iter->second.second + "]";
-                if (++iter != reactionTimes[i].end()) {
-                    result += ",";
-                }
-            }
-            if (i == reactionTimes.size() - 1) {
-                result += "]";
-            }
-            else {
-                result += "],";
-            }
-        }
+        return sessionExportReactionData(defaultSession());
+    }
 
-        result += "]";
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportEventsData() {
+        return sessionExportEventsData(defaultSession());
+    }
 
-        //create a null terminated C string on the heap so that our string's memory isn't wiped out right after method's return
-        char* cString = (char*)malloc(strlen(result.c_str()) + 1);
-        strcpy(cString, result.c_str());
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportReactionDataSince(ExportCursor* cursor) {
+        return sessionExportReactionDataSince(defaultSession(), cursor);
+    }
 
-        return cString;
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportEventsDataSince(ExportCursor* cursor) {
+        return sessionExportEventsDataSince(defaultSession(), cursor);
     }
 
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportTelemetryData() {
+        return sessionExportTelemetryData(defaultSession());
+    }
 
 #ifndef MAC_BUILD
-__declspec(dllexport)
+    __declspec(dllexport)
 #endif
-char* exportEventsData() {
-    std::vector<std::map<long, std::string>> eventsLog = StateMachine::GetInstance().getCollectedData().second;
-    std::string result = "[";
+    char* exportTelemetryDataSince(ExportCursor* cursor) {
+        return sessionExportTelemetryDataSince(defaultSession(), cursor);
+    }
 
-    for (int i = 0; i < eventsLog.size(); i++) {
-        result += "[" + std::to_string(i) + ",";
-        for (auto iter = eventsLog[i].begin(); iter != eventsLog[i].end(); ) {
-            result += "[" + std::to_string(iter->first) + "," + iter->second + "]";
-            if (++iter != eventsLog[i].end()) {
-                result += ",";
-            }
-        }
-        if (i == eventsLog.size() - 1) {
-            result += "]";
-        }
-        else {
-            result += "],";
-        }
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t exportDataInto(ExportKind kind, ExportCursor* cursor, char* buffer, size_t capacity) {
+        return sessionExportDataInto(defaultSession(), kind, cursor, buffer, capacity);
     }
 
-    result += "]";
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportRequest requestExport(ExportKind kind, ExportCursor since, void (*completion)(ExportRequest request, void* context), void* context) {
+        return sessionRequestExport(defaultSession(), kind, since, completion, context);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportStatus pollExport(ExportRequest request, char** data, size_t* size, ExportCursor* next) {
+        return sessionPollExport(defaultSession(), request, data, size, next);
+    }
 
-    //create a null terminated C string on the heap so that our string's memory isn't wiped out right after method's return
-    char* cString = (char*)malloc(strlen(result.c_str()) + 1);
-    strcpy(cString, result.c_str());
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportBinary(size_t* size) {
+        return sessionExportBinary(defaultSession(), size);
+    }
 
-    return cString;
-}
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t exportBinaryInto(void* buffer, size_t capacity) {
+        return sessionExportBinaryInto(defaultSession(), buffer, capacity);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void freeExportedData(char* data) {
+        CallMetrics::Scope scope(EntryFreeExportedData);
+        free(data);
+    }
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool getPluginMetrics(PluginMetrics* metrics) {
+        if (metrics == nullptr) {
+            return false;
+        }
+        CallMetrics::Snapshot snapshot;
+        CallMetrics::snapshot(snapshot);
+        metrics->seconds = snapshot.seconds;
+        for (size_t i = 0; i < EntryPointCount; i++) {
+            toLatencyMetrics(snapshot.entryPoints[i], metrics->entryPoints[i]);
+        }
+        for (size_t event = 0; event < CallMetrics::k_eventCount; event++) {
+            for (size_t state = 0; state < CallMetrics::k_stateCount; state++) {
+                toLatencyMetrics(snapshot.transitions[event][state], metrics->transitions[event][state]);
+            }
+        }
+        metrics->assertStates = snapshot.assertStates;
+        return true;
+    }
 
 }
@@ -8,6 +8,128 @@
 #ifndef main_hpp
 #define main_hpp
 
+#include <stddef.h>
+
+// Opaque handle to an independent measurement session.
+typedef struct SecondaryTaskSession* SessionHandle;
+
+// Position in a session's exported records. Start from 0; each *Since export returns
+// the records appended after the cursor and advances it. Stopping the measurement
+// invalidates cursors, the next call then starts over from the first record.
+typedef unsigned long long ExportCursor;
+
+// What sessionExportDataInto/exportDataInto serialise.
+typedef enum ExportKind {
+    ExportReactions = 0,
+    ExportEvents = 1,
+    ExportPositionDictionary = 2,   // cursor is ignored
+    ExportTelemetry = 3
+} ExportKind;
+
+// Background export handed out by requestExport/sessionRequestExport, never 0.
+typedef unsigned long long ExportRequest;
+
+typedef enum ExportStatus {
+    ExportPending = 0,      // still being serialised
+    ExportReady = 1,        // the data was handed over and the request is gone, unless data was null
+    ExportUnknown = 2       // not a pending request of this session, or already taken
+} ExportStatus;
+
+// Typed event for high rate telemetry (gaze, head pose, input...), see addEventLogBatch.
+// id is the host's own; fields past fieldCount are ignored, as is a fieldCount above 8.
+typedef struct TelemetryEvent {
+    unsigned int id;
+    unsigned int fieldCount;
+    float fields[8];
+} TelemetryEvent;
+
+// Running reaction time figures of one milestone group, see getMilestoneStats.
+// Times are in milliseconds and only cover the responses, not timeouts or false starts.
+typedef struct MilestoneStats {
+    unsigned int responses;
+    unsigned int timeouts;
+    unsigned int falseStarts;       // responses under 100 ms, exported as 5000 ms with outcome 2
+    double mean;
+    double variance;                // sample variance, ms squared
+    double min;
+    double max;
+    double median;                  // streaming estimates, exact up to five responses
+    double p90;
+} MilestoneStats;
+
+// Timing histograms every session keeps, to quantify its measurement error.
+typedef enum TimingMeasure {
+    TimingSignalTimerLateness = 0,      // how late the stimulus was raised after it was due
+    TimingResponseTimerLateness = 1,    // how late a response timeout was handled after it was due
+    TimingSignalDelivery = 2,           // signal handler duration; poll mode: stimulus raised until presented
+    TimingCommandDispatchLag = 3        // any API call until the session acted on it
+} TimingMeasure;
+
+// Microseconds. Quantiles come from log-linear buckets and are within 6.25% of the true value.
+typedef struct TimingSummary {
+    unsigned long long count;
+    double mean;
+    double median;
+    double p90;
+    double p99;
+    double max;
+} TimingSummary;
+
+// Plugin API entry points counted by getPluginMetrics. The legacy default session calls count
+// as their session counterparts, channel variants as the call without a channel.
+typedef enum PluginEntryPoint {
+    EntryCreateSession = 0,             // createSession, createVirtualSession
+    EntryDestroySession = 1,
+    EntryRecoverSession = 2,
+    EntryInitializeStimulusHandler = 3,
+    EntryStartMeasurement = 4,
+    EntryStopMeasurement = 5,
+    EntryRespondToStimulus = 6,
+    EntryAddMilestone = 7,
+    EntryAddEventLog = 8,
+    EntryAddTelemetry = 9,              // addTelemetryEvent, addEventLogBatch
+    EntrySetSchedule = 10,              // uniform, exponential and list schedules
+    EntrySetStimulusSeed = 11,
+    EntryAddStimulusChannel = 12,
+    EntryPeekNextStimulusTime = 13,
+    EntryPollStimulus = 14,
+    EntryReportStimulusPresented = 15,
+    EntrySetOption = 16,                // timing resolution, position ids, log level, poll mode, response timeout
+    EntryDrainDebugLog = 17,
+    EntryJournal = 18,                  // enable, disable and flush
+    EntryTrace = 19,                    // start and stop
+    EntryGetStatistics = 20,            // milestone stats, timing summary and histogram, memory usage, timing reset
+    EntryAdvanceClock = 21,             // and advanceToNextDeadline
+    EntryExportData = 22,               // the JSON exports, with or without a cursor
+    EntryExportDataInto = 23,
+    EntryRequestExport = 24,
+    EntryPollExport = 25,
+    EntryExportBinary = 26,             // and exportBinaryInto
+    EntryFreeExportedData = 27,
+    EntryPointCount = 28
+} PluginEntryPoint;
+
+// Calls of one entry point or transition across every thread and session. Times are in
+// microseconds; the quantiles come from power of two buckets and are within a factor of 1.5.
+typedef struct LatencyMetrics {
+    unsigned long long calls;
+    double mean;
+    double median;
+    double p99;
+    double max;
+} LatencyMetrics;
+
+// Counters of the whole plugin since its first call, see getPluginMetrics.
+typedef struct PluginMetrics {
+    double seconds;                                         // since the first call, to turn counts into rates
+    LatencyMetrics entryPoints[EntryPointCount];            // as seen by the caller, queued work not included
+    // Transitions taken and the executor's time for each, by event (start, stimulus due, signal
+    // sent, response, response timeout, response processed) and the state it arrived in (waiting
+    // for start, idle, sending signal, waiting for response, processing response).
+    LatencyMetrics transitions[6][5];
+    unsigned long long assertStates;                        // events the state had no transition for
+} PluginMetrics;
+
 extern "C"
 {
 #ifndef MAC_BUILD
@@ -34,7 +156,216 @@ extern "C"
     __declspec(dllexport)
 #endif
     void addEventLog(const char* eventName);
+    // Typed counterpart of addEventLog: an id plus up to 8 numbers, stored without allocating and
+    // kept even when several share a timestamp. A batch (e.g. everything sampled in one frame)
+    // costs one call and gets the time of that call. Exported by exportTelemetryData, grouped
+    // by the same milestones as the events. Null fields or events count as none.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void addTelemetryEvent(unsigned int id, const float* fields, size_t fieldCount);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void addEventLogBatch(const TelemetryEvent* events, size_t count);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setHighResolutionTiming(bool enabled);
+    // Debug messages are queued without formatting and delivered to the debug log handler
+    // from a background thread (virtual sessions: right away). Levels are 0 error,
+    // 1 warning, 2 info, 3 debug, 4 trace; messages above level are skipped. Default 4.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setLogLevel(int level);
+    // Delivers the messages of every call made so far, on the calling thread. Returns how many.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t drainDebugLog();
+    // Journals everything the session records to path (truncating it), syncing to disk every
+    // flushIntervalMilliseconds, or on every record when 0. What was recorded before the
+    // call is written first. Returns false if the file can't be created or written.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool enableJournal(const char* path, unsigned flushIntervalMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void disableJournal();
+    // Returns once everything recorded so far is synced to disk. False once a write or sync of
+    // the journal failed (disk full, I/O error): it then stops at what reached the disk before,
+    // and the session's debug log says so.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool flushJournal();
+    // Wait before each stimulus: uniform over [min, max] (the default, 15 to 25 s), a flat
+    // hazard (min plus an exponential wait with the given mean, cut off at max) or a fixed list
+    // of waits played in order and repeated. Takes effect from the next wait; an empty list is ignored.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setUniformSchedule(unsigned minMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setExponentialSchedule(unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setScheduleList(const unsigned* intervalsMilliseconds, size_t count);
+    // Reseeds the session's random waits; the same seed replays the same schedule.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setStimulusSeed(unsigned long long seed);
+    // Nanoseconds until the next stimulus (0 if due), -1 while none is scheduled, which is
+    // the case from the stimulus until the response has been processed.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long peekNextStimulusTime();
+    // Poll mode: the stimulus handlers are no longer called. Instead call pollStimulus once per
+    // frame, from any thread, with that frame's timestamp (nanoseconds, any monotonic clock); it
+    // returns whether the stimulus is to be shown. Then report the timestamp, on the same clock,
+    // at which the frame that first showed it was presented. That time becomes the onset the
+    // reaction time is measured from, and the time from the stimulus being raised to that
+    // present is exported as the callback duration. The host's clock is related to the session's
+    // through the polls, by the least delay any of the last 64 saw since its frame's timestamp.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setPollMode(bool enabled);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool pollStimulus(long long frameTimestamp);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void reportStimulusPresented(long long presentTimestamp);
+    // Stimulus channels run side by side in one session, each with its own state, schedule,
+    // response timeout and callbacks, on the session's thread and timers. Channel 0 is the one
+    // the functions without a channel drive. Returns the new channel's index, or -1 once the
+    // session has 8. A channel added during a measurement starts right away; channels stay
+    // until the session is destroyed, but stopping the measurement clears their callbacks.
+    // Reaction exports of sessions with more than one channel add each reaction's channel before its outcome.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    int addStimulusChannel();
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelInitializeStimulusHandler(unsigned channel, void (*signalHandler)(), void (*signalStopHandler)());
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelRespondToStimulus(unsigned channel, const char* pos);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetUniformSchedule(unsigned channel, unsigned minMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetExponentialSchedule(unsigned channel, unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetScheduleList(unsigned channel, const unsigned* intervalsMilliseconds, size_t count);
+    // How long the channel's stimulus waits for a response, 5000 by default. A timed out
+    // stimulus is exported with the time it waited; responses too early to be genuine are
+    // still exported as 5000 ms, whatever the timeout.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetResponseTimeout(unsigned channel, unsigned milliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long channelPeekNextStimulusTime(unsigned channel);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelSetPollMode(unsigned channel, bool enabled);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool channelPollStimulus(unsigned channel, long long frameTimestamp);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void channelReportStimulusPresented(unsigned channel, long long presentTimestamp);
+    // Figures of milestone group index (numbered as in exportReactionData), kept up to date as
+    // each response is processed, so reading them is cheap enough to do every frame. Calls made
+    // just before may not be reflected yet. Returns false if the group doesn't exist (yet).
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool getMilestoneStats(unsigned index, MilestoneStats* stats);
+    // Any thread, without waiting for the session. False for an unknown measure.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool getTimingSummary(TimingMeasure measure, TimingSummary* summary);
+    // Copies up to capacity bucket counts and returns the number of buckets. Bucket i counts
+    // the durations from timingHistogramBucketStart(i) up to the start of bucket i + 1.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t getTimingHistogram(TimingMeasure measure, unsigned long long* counts, size_t capacity);
+    // Nanoseconds, -1 past the last bucket.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long timingHistogramBucketStart(size_t index);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void resetTiming();
+    // Bytes the session's recorded data occupies. Full blocks of records are kept compressed.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t getMemoryUsage();
+    // Calls dropped since the session was created because its queue was full. The calls that
+    // hand over work never wait for it to run: when the session's thread stalls (in a slow
+    // callback, say) and 1024 calls pile up, the next ones return at once and are counted here.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    unsigned long long getDroppedCalls();
+    // Records startMeasurement, respondToStimulus, addMilestone, addEventLog, the telemetry events,
+    // stopMeasurement and the schedule and seed setters, with their arguments and timing, to a compact binary trace
+    // at path (truncating it) until stopTrace, for the replay tool. The trace opens with the
+    // session's seed, channels, schedules and response timeouts as they are, so the replay starts
+    // from the same settings; the session isn't changed. Stimuli come at the same times as long as
+    // no wait was drawn between setting the seed and starting the trace. Other calls made before
+    // the trace started aren't in it. Returns false if the file can't be created.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool startTrace(const char* path);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void stopTrace();
+    // Reaction exports then carry [ms,reaction,positionId,outcome]; exportPositionDictionary maps ids to names.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void setExportPositionIds(bool enabled);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportPositionDictionary();
 
+    // [[milestone,[ms,reaction,"position",outcome],...],...]; outcome is 0 for a response,
+    // 1 for a timeout and 2 for a false start. High resolution mode adds the callback duration.
 #ifndef MAC_BUILD
     __declspec(dllexport)
 #endif
@@ -44,5 +375,339 @@ extern "C"
     __declspec(dllexport)
 #endif
     char* exportEventsData();
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportReactionDataSince(ExportCursor* cursor);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportEventsDataSince(ExportCursor* cursor);
+
+    // [[milestone,[ms,id,field,...],...],...]; microseconds in high resolution mode.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportTelemetryData();
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportTelemetryDataSince(ExportCursor* cursor);
+
+    // Serialises into a caller owned buffer and returns the bytes needed, terminator included.
+    // Call with a null buffer to size it, then again to fill it. The buffer only holds a valid
+    // export, and the cursor (which may be null) only advances, when the result fits. A session
+    // that is still recording can outgrow the first answer, so repeat while the result exceeds capacity.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t exportDataInto(ExportKind kind, ExportCursor* cursor, char* buffer, size_t capacity);
+
+    // Background export that never blocks the calling thread. The export covers the calls made
+    // before the request, or only the records appended after since (0 for all of them), as the
+    // *Since exports do; measurement carries on meanwhile. Serialised on a worker thread shared by
+    // every session, which then calls completion (may be null) with the request, also for virtual
+    // sessions. Collect the result with pollExport, from the completion or any other thread.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportRequest requestExport(ExportKind kind, ExportCursor since, void (*completion)(ExportRequest request, void* context), void* context);
+
+    // Once ready hands over the export, released with freeExportedData, with its size (terminator
+    // excluded) and the cursor to pass as since next time; size and next may be null. With data
+    // null it only reports the status and a ready export stays to be collected. Results not
+    // collected are released by destroySession, which also waits for a completion that is running.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportStatus pollExport(ExportRequest request, char** data, size_t* size, ExportCursor* next);
+
+    // Whole session in the binary format of BinaryFormat.hpp; *size receives its length.
+    // Returns null (and 0) if the session's strings exceed the format's 4 GiB limit.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* exportBinary(size_t* size);
+
+    // Size-then-fill variant of exportBinary; writes only when the returned size fits.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t exportBinaryInto(void* buffer, size_t capacity);
+
+    // Releases data returned by any of the export functions.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void freeExportedData(char* data);
+
+    // Any thread, always available: calls and latency of every entry point and of the state
+    // machine transitions of all sessions. False if metrics is null.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool getPluginMetrics(PluginMetrics* metrics);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    SessionHandle createSession();
+    // Session on a simulated clock driven by sessionAdvanceClock/sessionAdvanceToNextDeadline.
+    // Its calls and callbacks all run on the calling thread.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    SessionHandle createVirtualSession();
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void destroySession(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionInitializeStimulusHandler(SessionHandle session, void (*signalHandler)(), void (*signalStopHandler)(), void (*debugLogHandler)(const char*));
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionStartMeasurement(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionRespondToStimulus(SessionHandle session, const char* pos);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionStopMeasurement(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddMilestone(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddEventLog(SessionHandle session, const char* eventName);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddTelemetryEvent(SessionHandle session, unsigned int id, const float* fields, size_t fieldCount);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionAddEventLogBatch(SessionHandle session, const TelemetryEvent* events, size_t count);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetHighResolutionTiming(SessionHandle session, bool enabled);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetExportPositionIds(SessionHandle session, bool enabled);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetLogLevel(SessionHandle session, int level);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionDrainDebugLog(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionEnableJournal(SessionHandle session, const char* path, unsigned flushIntervalMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionDisableJournal(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionFlushJournal(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetUniformSchedule(SessionHandle session, unsigned minMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetExponentialSchedule(SessionHandle session, unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetScheduleList(SessionHandle session, const unsigned* intervalsMilliseconds, size_t count);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetStimulusSeed(SessionHandle session, unsigned long long seed);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionPeekNextStimulusTime(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionSetPollMode(SessionHandle session, bool enabled);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionPollStimulus(SessionHandle session, long long frameTimestamp);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionReportStimulusPresented(SessionHandle session, long long presentTimestamp);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    int sessionAddStimulusChannel(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelInitializeStimulusHandler(SessionHandle session, unsigned channel, void (*signalHandler)(), void (*signalStopHandler)());
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelRespondToStimulus(SessionHandle session, unsigned channel, const char* pos);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetUniformSchedule(SessionHandle session, unsigned channel, unsigned minMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetExponentialSchedule(SessionHandle session, unsigned channel, unsigned minMilliseconds, unsigned meanMilliseconds, unsigned maxMilliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetScheduleList(SessionHandle session, unsigned channel, const unsigned* intervalsMilliseconds, size_t count);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetResponseTimeout(SessionHandle session, unsigned channel, unsigned milliseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionChannelPeekNextStimulusTime(SessionHandle session, unsigned channel);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelSetPollMode(SessionHandle session, unsigned channel, bool enabled);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionChannelPollStimulus(SessionHandle session, unsigned channel, long long frameTimestamp);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionChannelReportStimulusPresented(SessionHandle session, unsigned channel, long long presentTimestamp);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionGetMilestoneStats(SessionHandle session, unsigned index, MilestoneStats* stats);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionGetTimingSummary(SessionHandle session, TimingMeasure measure, TimingSummary* summary);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionGetTimingHistogram(SessionHandle session, TimingMeasure measure, unsigned long long* counts, size_t capacity);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionResetTiming(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionGetMemoryUsage(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    unsigned long long sessionGetDroppedCalls(SessionHandle session);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    bool sessionStartTrace(SessionHandle session, const char* path);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    void sessionStopTrace(SessionHandle session);
+    // Virtual session holding the measurement a journal recorded last, up to where the
+    // file was cut off by a crash. Export it as usual, then destroySession. Null on failure.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    SessionHandle recoverSession(const char* journalPath);
+    // Virtual sessions only. Return the session time in nanoseconds after advancing;
+    // sessionAdvanceToNextDeadline returns -1 when no timer is pending.
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionAdvanceClock(SessionHandle session, long long nanoseconds);
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    long long sessionAdvanceToNextDeadline(SessionHandle session);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportReactionData(SessionHandle session);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportEventsData(SessionHandle session);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportReactionDataSince(SessionHandle session, ExportCursor* cursor);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportEventsDataSince(SessionHandle session, ExportCursor* cursor);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportTelemetryData(SessionHandle session);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportTelemetryDataSince(SessionHandle session, ExportCursor* cursor);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionExportDataInto(SessionHandle session, ExportKind kind, ExportCursor* cursor, char* buffer, size_t capacity);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportRequest sessionRequestExport(SessionHandle session, ExportKind kind, ExportCursor since, void (*completion)(ExportRequest request, void* context), void* context);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    ExportStatus sessionPollExport(SessionHandle session, ExportRequest request, char** data, size_t* size, ExportCursor* next);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportBinary(SessionHandle session, size_t* size);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    size_t sessionExportBinaryInto(SessionHandle session, void* buffer, size_t capacity);
+
+#ifndef MAC_BUILD
+    __declspec(dllexport)
+#endif
+    char* sessionExportPositionDictionary(SessionHandle session);
 }
 #endif /* main_hpp */
@@ -5,61 +5,81 @@
 //  Created by Fernando Macedo on 04/11/2021.
 //
 
-#include <iostream>
-#include <chrono>
-#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
 
-#include "StateMachine.hpp"
+#include "../src/main.hpp"
+
+static const long long k_nanosecondsPerMillisecond = 1000000;
+
+static bool s_verbose = false;
+static bool s_stimulusPending = false;
+static unsigned s_stimuliSent = 0;
 
 void logFunc(const char* text) {
-    printf(text);
-    printf("\n");
+    if (s_verbose) {
+        printf("%s\n", text);
+    }
 }
 
 void handlerFunc() {
-    printf("Signal Received\n");
+    s_stimulusPending = true;
+    s_stimuliSent++;
 }
 
 void stopHandlerFunc() {
-    printf("Signal Stop\n");
+    s_stimulusPending = false;
 }
 
-char* exportData() {
-    std::vector<std::map<long,long>> reactionTimes = StateMachine::GetInstance().getReactionTimes();
-    std::string result = "[";
-    
-    for (int i = 0; i < reactionTimes.size(); i++) {
-        result += "[" + std::to_string(i) + ",";
-        for (auto iter = reactionTimes[i].begin(); iter != reactionTimes[i].end(); ) {
-            result += "[" + std::to_string(iter->first) + "," + std::to_string(iter->second) + "]";
-            if (++iter != reactionTimes[i].end()) {
-                result += ",";
-            }
-        }
-        if (i == reactionTimes.size()-1) {
-            result += "]";
+// Runs a simulated participant through a virtual time session, so a full protocol
+// finishes in milliseconds: usage sty [minutes] [-v]
+int main(int argc, const char * argv[]) {
+    long long minutes = 60;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            s_verbose = true;
         } else {
-            result += "],";
+            minutes = atoll(argv[i]);
         }
     }
-    
-    result += "]";
-    
-    //create a null terminated C string on the heap so that our string's memory isn't wiped out right after method's return
-    char* cString = (char*)malloc(strlen(result.c_str()) + 1);
-    strcpy(cString, result.c_str());
 
-    return cString;
-}
+    std::minstd_rand random(42);
+    std::uniform_int_distribution<long long> reactionMs(200, 900);
+    std::uniform_int_distribution<int> percent(0, 99);
 
-int main(int argc, const char * argv[]) {
-    StateMachine::GetInstance().setDebugLogCallback(logFunc);
-    StateMachine::GetInstance().setSignalSendingCallback(handlerFunc);
-    StateMachine::GetInstance().setSignalStopCallback(stopHandlerFunc);
-    StateMachine::GetInstance().resetState();
-    StateMachine::GetInstance().processEvent(Event::StartMeasure);
-    std::this_thread::sleep_for(std::chrono::seconds(30));
-    auto data = exportData();
-    std::this_thread::sleep_for(std::chrono::seconds(3));
+    SessionHandle session = createVirtualSession();
+    sessionInitializeStimulusHandler(session, handlerFunc, stopHandlerFunc, logFunc);
+    sessionStartMeasurement(session);
+
+    const long long end = minutes * 60 * 1000 * k_nanosecondsPerMillisecond;
+    const long long milestoneEvery = 10 * 60 * 1000 * k_nanosecondsPerMillisecond;
+    long long nextMilestone = milestoneEvery;
+    long long now = 0;
+    while (now < end) {
+        now = sessionAdvanceToNextDeadline(session);
+        if (now < 0) {
+            break;
+        }
+        if (s_stimulusPending && percent(random) >= 10) { // one in ten stimuli is missed and times out
+            now = sessionAdvanceClock(session, reactionMs(random) * k_nanosecondsPerMillisecond);
+            sessionRespondToStimulus(session, percent(random) < 50 ? "left" : "right");
+        }
+        if (now >= nextMilestone) {
+            sessionAddMilestone(session);
+            sessionAddEventLog(session, "milestone");
+            nextMilestone += milestoneEvery;
+        }
+    }
+
+    char* reactionData = sessionExportReactionData(session);
+    char* eventsData = sessionExportEventsData(session);
+    printf("%u stimuli in %lld simulated minutes\n", s_stimuliSent, minutes);
+    printf("%s\n%s\n", reactionData, eventsData);
+    freeExportedData(reactionData);
+    freeExportedData(eventsData);
+
+    destroySession(session);
     return 0;
 }